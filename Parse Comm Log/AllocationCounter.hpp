@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Counts every allocation made through operator new (which the containers and strings all use), for
+// the stage allocations --metrics and --bench report. Replaces the program's global operator new and
+// delete, so it is only for the front-end executables - include it in the one file with main and call
+// countAllocationsWith(countedAllocations) before the run. The core and the Python module never
+// replace the allocator of whatever links them
+
+#ifdef _MSC_VER
+#define ALLOCATIONS_THREAD_LOCAL __declspec(thread) // VS2013 has no thread_local
+#else
+#define ALLOCATIONS_THREAD_LOCAL thread_local
+#endif
+
+ALLOCATIONS_THREAD_LOCAL std::uint64_t allocation_count = { 0 };
+ALLOCATIONS_THREAD_LOCAL std::uint64_t allocated_bytes = { 0 };
+
+// Purpose: What the calling thread has allocated so far
+void countedAllocations(std::uint64_t &count, std::uint64_t &bytes)
+{
+	count = allocation_count;
+	bytes = allocated_bytes;
+}
+
+void *operator new(std::size_t size)
+{
+	++allocation_count;
+	allocated_bytes += size;
+
+	void *memory = std::malloc(size ? size : 1);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void *memory) throw()
+{
+	std::free(memory);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *memory, std::size_t) throw()
+{
+	std::free(memory);
+}
+#endif
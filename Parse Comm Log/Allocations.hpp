@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Allocations counted by the front-end, so a stage can report how many allocations it made and how
+// much it asked for. The core doesn't replace operator new itself - a program or module that links it
+// keeps its own allocator - so the counts are only there when the front-end counts them (see
+// AllocationCounter.hpp) and hands the core a way to read them. Otherwise every stage reports none
+//
+// Each thread counts its own, so a stage isn't charged with what the progress reporter or a read ahead
+// happened to allocate while it ran. A thread doing work for a stage measured on another thread - a
+// parse worker, a read ahead, a pipeline stage - hands what it allocated for it over with
+// AllocationSnapshot::credit
+
+// Reads what the calling thread has allocated. Set by the front-end before the run starts
+typedef void (*AllocationCounts)(std::uint64_t &count, std::uint64_t &bytes);
+AllocationCounts allocation_counts = { nullptr };
+
+// Handed over by other threads. Relaxed - a credit is always followed by the worker signalling it is
+// done, which orders it before the measuring thread looks
+std::atomic<std::uint64_t> credited_allocation_count(0);
+std::atomic<std::uint64_t> credited_allocated_bytes(0);
+
+// Allocations made so far - take one before and after a stage and subtract
+struct AllocationSnapshot
+{
+	std::uint64_t count;
+	std::uint64_t bytes;
+
+	// Purpose: What this thread has allocated, and what other threads have handed over to it
+	static AllocationSnapshot now()
+	{
+		AllocationSnapshot snapshot = onThisThread();
+		snapshot.count += credited_allocation_count.load(std::memory_order_relaxed);
+		snapshot.bytes += credited_allocated_bytes.load(std::memory_order_relaxed);
+		return snapshot;
+	}
+
+	// Purpose: What this thread alone has allocated
+	static AllocationSnapshot onThisThread()
+	{
+		AllocationSnapshot snapshot = { 0, 0 };
+		if (allocation_counts)
+		{
+			allocation_counts(snapshot.count, snapshot.bytes);
+		}
+		return snapshot;
+	}
+
+	// Purpose: Hand allocations made on this thread over to the stage being measured on another
+	static void credit(const AllocationSnapshot &allocations)
+	{
+		credited_allocation_count.fetch_add(allocations.count, std::memory_order_relaxed);
+		credited_allocated_bytes.fetch_add(allocations.bytes, std::memory_order_relaxed);
+	}
+
+	AllocationSnapshot since(const AllocationSnapshot &before) const
+	{
+		AllocationSnapshot difference = { count - before.count, bytes - before.bytes };
+		return difference;
+	}
+};
+
+// Hands everything a thread allocates while this is in scope over to the stage measured on another
+class AllocationCredit
+{
+public:
+	AllocationCredit()
+		:before(AllocationSnapshot::onThisThread())
+	{
+	}
+
+	~AllocationCredit()
+	{
+		AllocationSnapshot::credit(AllocationSnapshot::onThisThread().since(before));
+	}
+
+private:
+	AllocationSnapshot before;
+};
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+// Compact archive of a capture. The status bytes and the data bytes are split into two streams and
+// each is packed on its own - a status stream is almost all runs of a few values (00 for TX, 2D for RX
+// ...) and the data stream is mostly the same poll cycle over and over. Both are packed as literals and
+// repeats of what came just before: a run of one value is a repeat one byte back, a poll cycle is a
+// repeat one cycle back
+//
+// The capture is cut into blocks of 64K pairs that are packed and unpacked independently, with
+// an index at the end so a reader can find any block without unpacking the ones before it
+//
+//   header  "PCLZ" | version (16 bits) | 0 (16 bits) | pairs per block (32 bits)
+//   block   packed status stream | packed data stream
+//   index   per block: offset (64 bits) | pairs (32 bits) | status size (32 bits) | data size (32 bits)
+//   footer  index offset (64 bits) | blocks (32 bits) | "PCLZ"
+//
+// All numbers are little endian. A packed stream is a list of sequences, each a token byte (literal
+// count in the high nibble, repeat length - 4 in the low nibble, 15 meaning more length bytes follow)
+// then the literals, then the distance back (16 bits) and any more repeat length bytes. The last
+// sequence is literals only
+//
+// An odd byte at the end of a capture (half a pair) isn't kept - the framer ignores it anyway
+
+const char COMPACT_MAGIC[4] = { 'P', 'C', 'L', 'Z' };
+const std::uint16_t COMPACT_VERSION = { 1 };
+
+// Purpose: Is this a compact archive rather than a raw capture
+inline bool isCompactArchive(const std::vector<BYTE> &bytes)
+{
+	return (bytes.size() >= 4) && (std::memcmp(bytes.data(), COMPACT_MAGIC, 4) == 0);
+}
+
+// Purpose: Little endian numbers, one byte at a time so the byte order of the machine doesn't matter
+inline void putNumber(std::vector<BYTE> &out, std::uint64_t number, int bytes)
+{
+	for (int i = 0; i != bytes; ++i)
+	{
+		out.push_back((BYTE)(number >> (i * 8)));
+	}
+}
+
+inline std::uint64_t getNumber(const BYTE *in, int bytes)
+{
+	std::uint64_t number = 0;
+	for (int i = 0; i != bytes; ++i)
+	{
+		number |= (std::uint64_t)in[i] << (i * 8);
+	}
+	return number;
+}
+
+class StreamPacker
+{
+public:
+	// Shortest repeat worth a sequence of its own
+	static const std::size_t MIN_REPEAT = { 4 };
+
+	// Purpose: Pack a stream of at most 64K bytes (see above), adding it to out
+	void pack(const BYTE *in, std::size_t size, std::vector<BYTE> &out)
+	{
+		std::memset(positions, 0, sizeof(positions));
+
+		std::size_t literals = 0;
+		std::size_t i = 0;
+		while (i + MIN_REPEAT <= size)
+		{
+			std::uint32_t sequence = read32(in + i);
+			std::uint32_t &position = positions[(sequence * 2654435761U) >> (32 - HASH_BITS)];
+			std::size_t candidate = position; // 1 based - 0 is nothing seen yet
+			position = (std::uint32_t)(i + 1);
+
+			if (!candidate || (read32(in + candidate - 1) != sequence))
+			{
+				++i;
+				++literals;
+				continue;
+			}
+
+			std::size_t from = candidate - 1;
+			std::size_t length = MIN_REPEAT;
+			while ((i + length < size) && (in[from + length] == in[i + length]))
+			{
+				++length;
+			}
+
+			addSequence(out, in + i - literals, literals, i - from, length);
+			i += length;
+			literals = 0;
+		}
+
+		literals += size - i;
+		addSequence(out, in + size - literals, literals, 0, 0);
+	}
+
+private:
+	static std::uint32_t read32(const BYTE *in)
+	{
+		std::uint32_t value;
+		std::memcpy(&value, in, sizeof(value));
+		return value;
+	}
+
+	static void addLength(std::vector<BYTE> &out, std::size_t length)
+	{
+		for (; length >= 0xFF; length -= 0xFF)
+		{
+			out.push_back(0xFF);
+		}
+		out.push_back((BYTE)length);
+	}
+
+	// Purpose: Add literals then a repeat - a repeat length of 0 is the last sequence
+	static void addSequence(std::vector<BYTE> &out, const BYTE *literal, std::size_t literals, std::size_t distance, std::size_t length)
+	{
+		std::size_t extra = length ? (length - MIN_REPEAT) : 0;
+		out.push_back((BYTE)(((literals < 15) ? literals : 15) << 4 | ((extra < 15) ? extra : 15)));
+		if (literals >= 15)
+		{
+			addLength(out, literals - 15);
+		}
+		out.insert(out.end(), literal, literal + literals);
+
+		if (length)
+		{
+			putNumber(out, distance, 2);
+			if (extra >= 15)
+			{
+				addLength(out, extra - 15);
+			}
+		}
+	}
+
+	static const int HASH_BITS = { 14 };
+
+	std::uint32_t positions[1 << HASH_BITS];
+};
+
+// Purpose: Unpack a packed stream into exactly size bytes. Throws std::runtime_error if it is corrupt
+inline void unpackStream(const BYTE *in, std::size_t in_size, BYTE *out, std::size_t size)
+{
+	const BYTE *in_end = in + in_size;
+	std::size_t done = 0;
+
+	auto readLength = [&in, in_end](std::size_t length) -> std::size_t
+	{
+		if (length == 15)
+		{
+			BYTE more;
+			do
+			{
+				if (in == in_end)
+				{
+					throw std::runtime_error("Compact archive is corrupt");
+				}
+				more = *in++;
+				length += more;
+			} while (more == 0xFF);
+		}
+		return length;
+	};
+
+	for (;;)
+	{
+		if (in == in_end)
+		{
+			throw std::runtime_error("Compact archive is corrupt");
+		}
+		BYTE token = *in++;
+
+		std::size_t literals = readLength(token >> 4);
+		if (((std::size_t)(in_end - in) < literals) || (size - done < literals))
+		{
+			throw std::runtime_error("Compact archive is corrupt");
+		}
+		std::memcpy(out + done, in, literals);
+		in += literals;
+		done += literals;
+
+		if (in == in_end)
+		{
+			break; // Last sequence
+		}
+
+		if (in_end - in < 2)
+		{
+			throw std::runtime_error("Compact archive is corrupt");
+		}
+		std::size_t distance = (std::size_t)getNumber(in, 2);
+		in += 2;
+		std::size_t repeat = readLength(token & 0x0F) + StreamPacker::MIN_REPEAT;
+		if (!distance || (distance > done) || (size - done < repeat))
+		{
+			throw std::runtime_error("Compact archive is corrupt");
+		}
+
+		// A repeat may overlap itself - a run is a repeat one byte back
+		BYTE *to = out + done;
+		const BYTE *from = to - distance;
+		if (distance >= repeat)
+		{
+			std::memcpy(to, from, repeat);
+		}
+		else if (distance == 1)
+		{
+			std::memset(to, *from, repeat);
+		}
+		else
+		{
+			for (std::size_t i = 0; i != repeat; ++i)
+			{
+				to[i] = from[i];
+			}
+		}
+		done += repeat;
+	}
+
+	if (done != size)
+	{
+		throw std::runtime_error("Compact archive is corrupt");
+	}
+}
+
+// Purpose: Write a capture of status/data pairs as a compact archive
+inline void writeCompactArchive(std::ostream &o, const std::vector<BYTE> &bytes)
+{
+	static const std::size_t BLOCK_PAIRS = { 1 << 16 };
+
+	std::vector<BYTE> out(COMPACT_MAGIC, COMPACT_MAGIC + 4);
+	putNumber(out, COMPACT_VERSION, 2);
+	putNumber(out, 0, 2);
+	putNumber(out, BLOCK_PAIRS, 4);
+
+	StreamPacker packer;
+	std::vector<BYTE> index;
+	std::vector<BYTE> status(BLOCK_PAIRS);
+	std::vector<BYTE> data(BLOCK_PAIRS);
+	std::uint32_t blocks = 0;
+	std::size_t pair_count = bytes.size() / 2;
+
+	for (std::size_t pair = 0; pair != pair_count; ++blocks)
+	{
+		std::size_t pairs = pair_count - pair;
+		if (pairs > BLOCK_PAIRS)
+		{
+			pairs = BLOCK_PAIRS;
+		}
+
+		for (std::size_t i = 0; i != pairs; ++i)
+		{
+			status[i] = bytes[(pair + i) * 2];
+			data[i] = bytes[((pair + i) * 2) + 1];
+		}
+		pair += pairs;
+
+		std::size_t offset = out.size();
+		packer.pack(status.data(), pairs, out);
+		std::size_t status_size = out.size() - offset;
+		packer.pack(data.data(), pairs, out);
+
+		putNumber(index, offset, 8);
+		putNumber(index, pairs, 4);
+		putNumber(index, status_size, 4);
+		putNumber(index, out.size() - offset - status_size, 4);
+	}
+
+	std::size_t index_offset = out.size();
+	out.insert(out.end(), index.begin(), index.end());
+	putNumber(out, index_offset, 8);
+	putNumber(out, blocks, 4);
+	out.insert(out.end(), COMPACT_MAGIC, COMPACT_MAGIC + 4);
+
+	o.write((const char *)out.data(), out.size());
+}
+
+// A compact archive read into memory - blocks are unpacked one at a time as they are wanted
+class CompactArchive
+{
+public:
+	// Purpose: Read the index. Throws std::runtime_error if it isn't a compact archive this can read
+	explicit CompactArchive(const std::vector<BYTE> &bytes)
+		:bytes(bytes)
+	{
+		if ((bytes.size() < HEADER_SIZE + FOOTER_SIZE) || !isCompactArchive(bytes) ||
+			(std::memcmp(&bytes[bytes.size() - 4], COMPACT_MAGIC, 4) != 0))
+		{
+			throw std::runtime_error("Not a compact archive");
+		}
+		if (getNumber(&bytes[4], 2) != COMPACT_VERSION)
+		{
+			throw std::runtime_error("Compact archive is a version this can't read");
+		}
+
+		const BYTE *footer = &bytes[bytes.size() - FOOTER_SIZE];
+		std::uint64_t index_offset = getNumber(footer, 8);
+		std::uint64_t blocks = getNumber(footer + 8, 4);
+		if ((index_offset < HEADER_SIZE) || (index_offset + (blocks * INDEX_ENTRY_SIZE) != bytes.size() - FOOTER_SIZE))
+		{
+			throw std::runtime_error("Compact archive is corrupt");
+		}
+
+		for (std::uint64_t block = 0; block != blocks; ++block)
+		{
+			const BYTE *entry = &bytes[(std::size_t)(index_offset + (block * INDEX_ENTRY_SIZE))];
+			Block b;
+			b.offset = getNumber(entry, 8);
+			b.pairs = (std::size_t)getNumber(entry + 8, 4);
+			b.status_size = (std::size_t)getNumber(entry + 12, 4);
+			b.data_size = (std::size_t)getNumber(entry + 16, 4);
+			b.first_pair = pair_count;
+			if ((b.offset < HEADER_SIZE) || (b.offset + b.status_size + b.data_size > index_offset))
+			{
+				throw std::runtime_error("Compact archive is corrupt");
+			}
+
+			pair_count += b.pairs;
+			index.push_back(b);
+		}
+	}
+
+	std::size_t blocks() const { return index.size(); }
+
+	// Pairs in the whole capture
+	std::uint64_t pairs() const { return pair_count; }
+
+	std::uint64_t firstPair(std::size_t block) const { return index[block].first_pair; }
+
+	// Purpose: Unpack a block into its status bytes and data bytes. Returns the number of pairs
+	std::size_t unpackBlock(std::size_t block, std::vector<BYTE> &status, std::vector<BYTE> &data) const
+	{
+		const Block &b = index[block];
+		status.resize(b.pairs);
+		data.resize(b.pairs);
+
+		const BYTE *packed = &bytes[(std::size_t)b.offset];
+		unpackStream(packed, b.status_size, status.data(), b.pairs);
+		unpackStream(packed + b.status_size, b.data_size, data.data(), b.pairs);
+		return b.pairs;
+	}
+
+private:
+	struct Block
+	{
+		std::uint64_t offset;
+		std::size_t pairs;
+		std::size_t status_size;
+		std::size_t data_size;
+		std::uint64_t first_pair;
+	};
+
+	static const std::size_t HEADER_SIZE = { 12 };
+	static const std::size_t INDEX_ENTRY_SIZE = { 20 };
+	static const std::size_t FOOTER_SIZE = { 16 };
+
+	const std::vector<BYTE> &bytes;
+	std::vector<Block> index;
+	std::uint64_t pair_count = { 0 };
+};
+
+// Purpose: Turn a compact archive back into the status/data pairs of the capture
+inline std::vector<BYTE> expandArchive(const std::vector<BYTE> &bytes)
+{
+	CompactArchive archive(bytes);
+	std::vector<BYTE> pairs((std::size_t)archive.pairs() * 2);
+	std::vector<BYTE> status;
+	std::vector<BYTE> data;
+
+	for (std::size_t block = 0; block != archive.blocks(); ++block)
+	{
+		std::size_t count = archive.unpackBlock(block, status, data);
+		BYTE *to = &pairs[(std::size_t)archive.firstPair(block) * 2];
+		for (std::size_t i = 0; i != count; ++i)
+		{
+			to[i * 2] = status[i];
+			to[(i * 2) + 1] = data[i];
+		}
+	}
+
+	return pairs;
+}
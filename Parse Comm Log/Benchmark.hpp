@@ -0,0 +1,69 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "Allocations.hpp"
+
+// Times the stages of processing a capture one after another, each on its own, along with the
+// allocations each one made
+
+class Benchmark
+{
+public:
+	// Purpose: Start timing a stage
+	void start()
+	{
+		allocations = AllocationSnapshot::now();
+		started = boost::chrono::steady_clock::now();
+	}
+
+	// Purpose: Stop timing the stage and record how much it got through
+	void stop(const char *name, std::uint64_t bytes, std::uint64_t messages)
+	{
+		boost::chrono::duration<double> seconds = boost::chrono::steady_clock::now() - started;
+		AllocationSnapshot after = AllocationSnapshot::now();
+
+		Result result = { name, seconds.count(), bytes, messages, after.count - allocations.count, after.bytes - allocations.bytes };
+		results.push_back(result);
+	}
+
+	void report(std::ostream &o)
+	{
+		o << std::dec << std::setfill(' ') << std::fixed
+			<< "Stage     seconds        MB/s    messages/s   allocations  allocated MB" << std::endl;
+		for (auto &result : results)
+		{
+			double seconds = (result.seconds > 0) ? result.seconds : 1e-9;
+			o << std::left << std::setw(8) << result.name << std::right
+				<< std::setprecision(3) << std::setw(9) << result.seconds
+				<< std::setprecision(1) << std::setw(12) << (result.bytes / seconds / MEGABYTE)
+				<< std::setprecision(0) << std::setw(14) << (result.messages / seconds)
+				<< std::setw(14) << result.allocations
+				<< std::setprecision(1) << std::setw(14) << ((double)result.allocated_bytes / MEGABYTE) << std::endl;
+		}
+		o.unsetf(std::ios::fixed);
+		o << std::setprecision(6);
+	}
+
+private:
+	struct Result
+	{
+		const char *name;
+		double seconds;
+		std::uint64_t bytes;
+		std::uint64_t messages;
+		std::uint64_t allocations;
+		std::uint64_t allocated_bytes;
+	};
+
+	static const double MEGABYTE;
+
+	AllocationSnapshot allocations;
+	boost::chrono::steady_clock::time_point started;
+	std::vector<Result> results;
+};
+
+const double Benchmark::MEGABYTE = { 1024.0 * 1024.0 };
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Checkpoints of a batch decode - which capture it had got to and how far into it, along with
+// everything the framer, filter and statistics had built up by then - so a later run can carry on from
+// there rather than from byte 0 of the first capture. Once the batch is done the last checkpoint is
+// kept, so a capture that is appended to later is only framed from where the last run stopped. Delete
+// the checkpoint to start over
+//
+// Statistics are only reported at the end, so a resumed --stats run reports exactly what one run would
+// have. A listing can't take back what it has shown - when a capture it listed to the end is appended
+// to, the message that was in progress at the old end is shown again, now complete
+//
+// Each checkpoint is written to a new file that then replaces the old one, so a run killed while
+// writing one still leaves the one before it whole
+//
+//   PCLCHECKPOINT 1
+//   settings <what the run was asked for - a resumed run must ask for the same>
+//   capture <number in the batch> <offset> <file name>
+//   <framer, filter and statistics state>
+
+class BatchCheckpoint
+{
+public:
+	// Write and read back the state built up so far
+	std::function<void(std::ostream &)> save_state;
+	std::function<void(std::istream &)> restore_state;
+
+	// Purpose: Checkpoint to path. settings describes what was asked for (mode, filter) - a checkpoint is
+	// only resumed by a run that asks for the same
+	void set(const std::string &checkpoint_path, const std::string &run_settings)
+	{
+		path = checkpoint_path;
+		settings = run_settings;
+	}
+
+	bool active() const { return !path.empty(); }
+
+	// How often --stats is checkpointed, in capture bytes framed
+	static const std::uint64_t INTERVAL_BYTES = { 64 * 1024 * 1024 };
+
+	// Purpose: Restore the state from the checkpoint an earlier run left, if there is one. Returns
+	// false to start from the beginning. Throws std::runtime_error on a checkpoint that doesn't belong
+	// to this batch or can't be read
+	bool resume(const std::vector<std::string> &filenames)
+	{
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open())
+		{
+			return false;
+		}
+
+		std::string line;
+		if (!std::getline(in, line) || (line != MAGIC))
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+
+		if (!std::getline(in, line) || (line.compare(0, 9, "settings ") != 0))
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+		if (line.substr(9) != settings)
+		{
+			throw std::runtime_error("Checkpoint is for a different run (" + line.substr(9) + ")");
+		}
+
+		std::string word;
+		std::string filename;
+		in >> word >> capture >> offset;
+		if (!in || (word != "capture") || (in.get() != ' ') || !std::getline(in, filename))
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+		if ((capture >= filenames.size()) || (filenames[capture] != filename))
+		{
+			throw std::runtime_error("Checkpoint is for capture '" + filename + "', which isn't in the same place in this batch");
+		}
+
+		restore_state(in);
+		return true;
+	}
+
+	// Where a resumed batch picks up
+	std::size_t resumeCapture() const { return capture; }
+	std::uint64_t resumeOffset() const { return offset; }
+
+	// Purpose: Take a checkpoint now, to be written by commit once everything before it has been output
+	void take(std::size_t capture_number, const std::string &filename, std::uint64_t capture_offset)
+	{
+		std::ostringstream checkpoint;
+		checkpoint << MAGIC << '\n'
+			<< "settings " << settings << '\n'
+			<< "capture " << capture_number << ' ' << capture_offset << ' ' << filename << '\n';
+		save_state(checkpoint);
+		taken = checkpoint.str();
+	}
+
+	// Purpose: Write the checkpoint taken last. Throws std::runtime_error if it can't be written
+	void commit()
+	{
+		if (taken.empty())
+		{
+			return;
+		}
+
+		std::string replacement = path + ".new";
+		{
+			std::ofstream out(replacement, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!out.is_open() || !out.write(taken.data(), taken.size()) || !out.flush())
+			{
+				throw std::runtime_error("Checkpoint could not be written");
+			}
+		}
+
+#ifdef _WIN32
+		bool replaced = (MoveFileExA(replacement.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+		bool replaced = (std::rename(replacement.c_str(), path.c_str()) == 0);
+#endif
+		if (!replaced)
+		{
+			throw std::runtime_error("Checkpoint could not be written");
+		}
+		taken.clear();
+	}
+
+	// Purpose: Take a checkpoint and write it straight away
+	void write(std::size_t capture_number, const std::string &filename, std::uint64_t capture_offset)
+	{
+		take(capture_number, filename, capture_offset);
+		commit();
+	}
+
+private:
+	static const char *const MAGIC;
+
+	std::string path;
+	std::string settings;
+	std::string taken;
+	std::size_t capture = { 0 };
+	std::uint64_t offset = { 0 };
+};
+
+const char *const BatchCheckpoint::MAGIC = { "PCLCHECKPOINT 1" };
+
+BatchCheckpoint batch_checkpoint;
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+// Collapse runs of a repeating sequence of messages (e.g. the general poll cycle) into one copy of
+// the sequence and a repeat count. Works on the messages as they are framed, keeping no more than
+// a few periods of them, so only the messages that are actually shown get parsed and formatted
+//
+// A run of period p is spotted when the last 3p messages are the same p messages three times - two
+// would let a short period that happens to repeat once (e.g. two general polls in a row) hide the
+// real cycle. Each message is reduced to a hash and the sequence of hashes to a polynomial rolling
+// hash, so checking every period 1..N costs a couple of comparisons per period
+
+class RepeatCollapser
+{
+public:
+	// Called with each message that isn't part of a run
+	std::function<void(Message &)> emit_message;
+
+	// Called with one copy of a repeating sequence, the number of times it repeated and the offsets
+	// of the start of the first and the end of the last repeat
+	std::function<void(std::vector<Message> &, std::uint64_t, std::uint64_t, std::uint64_t)> emit_run;
+
+	// Purpose: Set the longest sequence of messages to look for repeats of
+	void setMaximumPeriod(std::size_t period)
+	{
+		maximum_period = period;
+
+		powers.assign((MIN_REPEATS * period) + 1, 1);
+		for (std::size_t i = 1; i != powers.size(); ++i)
+		{
+			powers[i] = powers[i - 1] * HASH_BASE;
+		}
+	}
+
+	bool active() const { return maximum_period != 0; }
+
+	// Purpose: Take the next framed message
+	void add(Message &message)
+	{
+		std::uint64_t hash = hashMessage(message);
+
+		if (!cycle.empty())
+		{
+			if (hash == cycle_hashes[position])
+			{
+				// Run continues
+				partial.push_back(message);
+				if (++position == cycle.size())
+				{
+					++repeats;
+					run_end = message.offset + (message.raw_status_and_data_bytes.size() * 2);
+					partial.clear();
+					position = 0;
+				}
+				return;
+			}
+
+			// Run is over - what was matched of an incomplete repeat goes back to be looked at again
+			endRun();
+		}
+
+		append(message, hash);
+	}
+
+	// Purpose: Emit whatever is still held back - call after the last message of a capture
+	void flush()
+	{
+		if (!cycle.empty())
+		{
+			endRun();
+		}
+
+		while (!pending.empty())
+		{
+			emitOldest();
+		}
+	}
+
+private:
+	// Purpose: Add a message that isn't part of a run and look for a repeat ending with it
+	void append(Message &message, std::uint64_t hash)
+	{
+		pending.push_back(message);
+		pending_hashes.push_back(hash);
+		prefix.push_back((prefix.back() * HASH_BASE) + hash);
+
+		std::size_t length = pending.size();
+		for (std::size_t period = 1; (period <= maximum_period) && ((MIN_REPEATS * period) <= length); ++period)
+		{
+			if (repeatsAt(length, period))
+			{
+				startRun(period);
+				return;
+			}
+		}
+
+		// Nothing older than 3N messages back can start a run any more
+		while (pending.size() > (MIN_REPEATS * maximum_period))
+		{
+			emitOldest();
+		}
+	}
+
+	// Purpose: Are the MIN_REPEATS * period pending messages before end the same period messages repeated
+	bool repeatsAt(std::size_t end, std::size_t period)
+	{
+		std::uint64_t last = rangeHash(end - period, end);
+		for (std::size_t repeat = 2; repeat <= MIN_REPEATS; ++repeat)
+		{
+			std::size_t begin = end - (repeat * period);
+			if ((rangeHash(begin, begin + period) != last) ||
+				!std::equal(pending_hashes.begin() + begin, pending_hashes.begin() + begin + period, pending_hashes.end() - period))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Purpose: The last MIN_REPEATS * period pending messages are a run - everything before them is emitted
+	void startRun(std::size_t period)
+	{
+		while (pending.size() > (MIN_REPEATS * period))
+		{
+			emitOldest();
+		}
+
+		cycle.assign(pending.begin(), pending.begin() + period);
+		cycle_hashes.assign(pending_hashes.begin(), pending_hashes.begin() + period);
+		repeats = MIN_REPEATS;
+		run_start = pending.front().offset;
+		run_end = pending.back().offset + (pending.back().raw_status_and_data_bytes.size() * 2);
+		position = 0;
+
+		clearPending();
+	}
+
+	void endRun()
+	{
+		emit_run(cycle, repeats, run_start, run_end);
+		cycle.clear();
+		cycle_hashes.clear();
+
+		std::vector<Message> unmatched;
+		unmatched.swap(partial);
+		for (auto &message : unmatched)
+		{
+			append(message, hashMessage(message));
+		}
+	}
+
+	void emitOldest()
+	{
+		emit_message(pending.front());
+		pending.pop_front();
+		pending_hashes.pop_front();
+		prefix.pop_front();
+	}
+
+	void clearPending()
+	{
+		pending.clear();
+		pending_hashes.clear();
+		prefix.assign(1, 0);
+	}
+
+	// Purpose: Rolling hash of pending_hashes[begin, end) from the prefix hashes
+	std::uint64_t rangeHash(std::size_t begin, std::size_t end)
+	{
+		return prefix[end] - (prefix[begin] * powers[end - begin]);
+	}
+
+	static const std::uint64_t HASH_BASE = { 1000003 };
+
+	// Repeats needed before a sequence is treated as a run
+	static const std::size_t MIN_REPEATS = { 3 };
+
+	std::size_t maximum_period = { 0 };
+	std::vector<std::uint64_t> powers;
+
+	// Messages not yet emitted. prefix[i] is the rolling hash of every message hash before pending[i],
+	// offset by whatever has already been emitted - which cancels out in rangeHash
+	std::deque<Message> pending;
+	std::deque<std::uint64_t> pending_hashes;
+	std::deque<std::uint64_t> prefix = std::deque<std::uint64_t>(1, 0);
+
+	// The run being collapsed
+	std::vector<Message> cycle;
+	std::vector<std::uint64_t> cycle_hashes;
+	std::vector<Message> partial;     // Messages matched so far of the next repeat
+	std::size_t position = { 0 };     // Next message of the cycle to match
+	std::uint64_t repeats = { 0 };
+	std::uint64_t run_start = { 0 };
+	std::uint64_t run_end = { 0 };
+};
+
+RepeatCollapser repeat_collapser;
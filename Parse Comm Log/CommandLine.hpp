@@ -0,0 +1,520 @@
+#pragma once
+
+#include <algorithm>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Command line options
+//
+//   Parse Comm Log [--filter <expression>] [--stats | --search <hex> | --collapse <period>] [--threads <count>] [--prefetch <files>] [file ...]
+//   Parse Comm Log [--filter <expression>] --diff <file> <file>
+//   Parse Comm Log --errors <window> [--burst <percent>] [file ...]
+//   Parse Comm Log [--filter <expression>] --pipeline [file ...]
+//   Parse Comm Log --generate <file> [--size <MB>] [--mix <mix>]
+//   Parse Comm Log [--filter <expression>] --bench [file ...]
+//   Parse Comm Log [--filter <expression>] --window <window> [file ...]
+//   Parse Comm Log --archive [file ...]
+//   Parse Comm Log --daemon <socket> [--threads <count>]
+//   Parse Comm Log [--filter <expression>] --live <device> [--gap <ms>]
+//   Parse Comm Log [--filter <expression>] [--stats] --checkpoint <file> [file ...]
+//   Parse Comm Log [--filter <expression>] [--stats] --stitch [file ...]
+//   Parse Comm Log [--filter <expression>] --meters [--series <file>] [--stitch | --checkpoint <file>] [file ...]
+//   Parse Comm Log [--filter <expression>] --meters --live <device> [--gap <ms>]
+//   Parse Comm Log --link <settings> [--stitch] [file ...]
+//   Parse Comm Log --index [file ...]
+//   Parse Comm Log [--filter <expression>] --sample <settings> [file ...]
+
+// What a run does with its captures. Each option that chooses one is a mode of its own - a run has
+// just one, as each takes the framed messages for itself
+enum class Mode
+{
+	LIST,
+	STATISTICS,
+	SEARCH,
+	DIFF,
+	COLLAPSE,
+	ERRORS,
+	PIPELINE,
+	GENERATE,
+	BENCH,
+	WINDOW,
+	ARCHIVE,
+	DAEMON,
+	METERS,
+	LINK,
+	INDEX,
+	SAMPLE
+};
+
+struct Options
+{
+	Mode mode = { Mode::LIST };
+	std::string mode_option;  // The option that chose the mode
+	std::vector<std::string> filenames;
+	std::string filter;
+	bool statistics = { false };
+	std::vector<std::string> search;
+	bool diff = { false };
+	std::size_t collapse = { 0 };
+	std::size_t error_window = { 0 };
+	double burst = { 1.0 };
+	bool pipeline = { false };
+	std::size_t threads = { std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1 };
+	std::size_t prefetch = { 4 };
+	std::string generate;
+	std::size_t size = { 64 };
+	std::string mix;
+	bool bench = { false };
+	std::string metrics;
+	std::string prometheus;
+	std::string window;
+	bool archive = { false };
+	std::string daemon;
+	std::string live;
+	std::size_t gap = { 5 };
+	std::string checkpoint;
+	bool stitch = { false };
+	bool meters = { false };
+	std::string series;
+	std::string link;
+	bool index = { false };
+	std::string sample;
+};
+
+inline void showUsage(std::ostream &o)
+{
+	o << "usage: Parse Comm Log [--filter <expression>] [--stats | --search <hex> | --collapse <period>] [--threads <count>] [--prefetch <files>] [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --diff <file> <file>" << std::endl
+		<< "       Parse Comm Log --errors <window> [--burst <percent>] [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --pipeline [file ...]" << std::endl
+		<< "       Parse Comm Log --generate <file> [--size <MB>] [--mix <mix>]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --bench [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --window <window> [file ...]" << std::endl
+		<< "       Parse Comm Log --archive [file ...]" << std::endl
+		<< "       Parse Comm Log --daemon <socket> [--threads <count>]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --live <device> [--gap <ms>]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] [--stats] --checkpoint <file> [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] [--stats] --stitch [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --meters [--series <file>] [--stitch | --checkpoint <file>] [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --meters --live <device> [--gap <ms>]" << std::endl
+		<< "       Parse Comm Log --link <settings> [--stitch] [file ...]" << std::endl
+		<< "       Parse Comm Log --index [file ...]" << std::endl
+		<< "       Parse Comm Log [--filter <expression>] --sample <settings> [file ...]" << std::endl
+		<< "  --filter <expression>  only keep messages matching the expression, e.g. \"lp=72,addr=01\"" << std::endl
+		<< "                         keys: dir, type, addr, lp, exc, err, bytes (see Filter.hpp)" << std::endl
+		<< "  --stats                count messages as they are framed and report totals instead of listing them" << std::endl
+		<< "  --search <hex>         report every occurrence of a sequence of data bytes, e.g. \"0172AB\", and" << std::endl
+		<< "                         the message it starts in. May be repeated to search for several at once" << std::endl
+		<< "  --collapse <period>    show runs of a repeating sequence of up to <period> messages once, with a" << std::endl
+		<< "                         repeat count, e.g. the general poll cycle" << std::endl
+		<< "  --diff                 show the messages deleted, inserted or changed between two captures" << std::endl
+		<< "  --errors <window>      report bursts of line errors in windows of <window> bytes of the capture (two" << std::endl
+		<< "                         to a byte on the line), straight from the status bytes without framing any messages" << std::endl
+		<< "  --burst <percent>      share of RX'd bytes with errors that makes a window part of a burst (default 1)" << std::endl
+		<< "  --pipeline             list the messages with reading, framing, parsing and writing each on their own" << std::endl
+		<< "                         thread, then report how long each stage took" << std::endl
+		<< "  --threads <count>      threads to parse messages with (default one per processor)" << std::endl
+		<< "  --prefetch <files>     captures to read ahead at once while earlier ones are processed (default 4)" << std::endl
+		<< "  --generate <file>      write a synthetic capture of --size MB (default 64) to the file. --mix sets the" << std::endl
+		<< "                         traffic, e.g. \"gp=60,lp=30,comment=10,exc=5,err=0.1,seed=1\" (see Generator.hpp)" << std::endl
+		<< "  --bench                time reading, framing, parsing and formatting each capture separately" << std::endl
+		<< "  --window <window>      only read and decode part of each capture - a byte range, message numbers or" << std::endl
+		<< "                         messages around a match, e.g. \"bytes=0x1000-0x2000\", \"messages=500-999\" or" << std::endl
+		<< "                         \"around=0172,2000\" (see Window.hpp)" << std::endl
+		<< "  --archive              write each capture as a compact archive, <file>.pcz, that can be read in place" << std::endl
+		<< "                         of the capture (see Archive.hpp)" << std::endl
+		<< "  --daemon <socket>      stay running and decode captures sent over a Unix domain socket, serving" << std::endl
+		<< "                         --threads clients at once (see Daemon.hpp). Not available on Windows" << std::endl
+		<< "  --live <device>        decode the capture device (a serial port or pty) as the traffic arrives, showing" << std::endl
+		<< "                         each message once it is complete, until Ctrl+C (see Live.hpp). Not available on Windows" << std::endl
+		<< "  --gap <ms>             quiet time that ends a live message when no other message follows (default 5)" << std::endl
+		<< "  --checkpoint <file>    note how far the batch has got in the file as it goes, and carry on from there if" << std::endl
+		<< "                         it is already there - e.g. after the run was killed or a capture was appended to." << std::endl
+		<< "                         --stats is checkpointed every 64 MB, listings after each capture (see Checkpoint.hpp)" << std::endl
+		<< "  --stitch               put rotated captures, <maker>_<mac>_SAS<port>_<epoch>.log, back in order and frame" << std::endl
+		<< "                         each machine and port as one stream, so messages cut by a rotation come out whole" << std::endl
+		<< "                         (see Stitch.hpp)" << std::endl
+		<< "  --meters               decode the meters in the responses to the meter long polls and report how each" << std::endl
+		<< "                         machine's meters moved, flagging rollbacks. With --live, show each change as it" << std::endl
+		<< "                         arrives (see Meters.hpp)" << std::endl
+		<< "  --series <file>        with --meters, also write every meter's first reading and changes as CSV" << std::endl
+		<< "  --link <settings>      report how the link's time is split between polls, responses and chirps, and" << std::endl
+		<< "                         the general poll cycle and what is left of it, e.g. \"baud=19200,cycle=200,span=3600\"" << std::endl
+		<< "                         (see Link.hpp)" << std::endl
+		<< "  --index                write an index of each capture, <file>.pci, of the poll codes, exception codes," << std::endl
+		<< "                         addresses and line errors in each part of it. A filtered listing of a capture" << std::endl
+		<< "                         with an index only decodes the parts the filter could match (see Index.hpp)" << std::endl
+		<< "  --sample <settings>    estimate what --stats would report, with 95% confidence intervals, from a random" << std::endl
+		<< "                         share of each capture, e.g. \"share=1,chunk=256,seed=1\" (see Sample.hpp)" << std::endl
+		<< "  --metrics <file>       write the time, CPU, memory and allocations of each stage as JSON (- for the console)" << std::endl
+		<< "  --prometheus <file>    write the same metrics in the Prometheus text file format (- for the console)" << std::endl;
+}
+
+// Purpose: Convert a (possibly wide) command line argument. Only ASCII is expected
+template <typename CharT>
+std::string narrowArgument(const CharT *argument)
+{
+	std::basic_string<CharT> wide(argument);
+	std::string narrow;
+	for (auto c : wide)
+	{
+		narrow += (char)c;
+	}
+	return narrow;
+}
+
+// Purpose: Convert a positive whole number argument
+inline std::size_t parseCount(const std::string &value, const std::string &option)
+{
+	std::size_t used = 0;
+	unsigned long count = 0;
+	try
+	{
+		count = std::stoul(value, &used);
+	}
+	catch (std::exception const&)
+	{
+		used = 0;
+	}
+
+	if (value.empty() || (used != value.size()) || (count == 0))
+	{
+		throw std::invalid_argument(option + " needs a positive number, not '" + value + "'");
+	}
+
+	return count;
+}
+
+// Purpose: Convert a positive percentage argument
+inline double parsePercent(const std::string &value, const std::string &option)
+{
+	std::size_t used = 0;
+	double percent = 0;
+	try
+	{
+		percent = std::stod(value, &used);
+	}
+	catch (std::exception const&)
+	{
+		used = 0;
+	}
+
+	if (value.empty() || (used != value.size()) || (percent <= 0) || (percent > 100))
+	{
+		throw std::invalid_argument(option + " needs a percentage above 0, not '" + value + "'");
+	}
+
+	return percent;
+}
+
+// Purpose: Convert the command line arguments, leaving out the program name
+template <typename CharT>
+std::vector<std::string> commandLineArguments(int argc, CharT* argv[])
+{
+	std::vector<std::string> arguments;
+	for (int i = 1; i < argc; ++i)
+	{
+		arguments.push_back(narrowArgument(argv[i]));
+	}
+	return arguments;
+}
+
+// Purpose: Note the mode an option chooses. Throws std::invalid_argument if another option has chosen
+// a different one
+inline void chooseMode(Options &options, Mode mode, const std::string &option)
+{
+	if ((options.mode != Mode::LIST) && (options.mode != mode))
+	{
+		throw std::invalid_argument(option + " can't be combined with " + options.mode_option + " - a run does one or the other");
+	}
+	options.mode = mode;
+	options.mode_option = option;
+}
+
+// Purpose: Check an option that changes how a mode runs is only given with the modes it works with.
+// Throws std::invalid_argument if it isn't
+inline void requireMode(const Options &options, bool given, const std::string &option, std::initializer_list<Mode> modes)
+{
+	if (given && (std::find(modes.begin(), modes.end(), options.mode) == modes.end()))
+	{
+		throw std::invalid_argument(option + " doesn't work " + ((options.mode == Mode::LIST) ? std::string("when listing messages") : ("with " + options.mode_option)));
+	}
+}
+
+// Purpose: Fill in the options from the command line arguments (without the program name). Throws
+// std::invalid_argument on a bad command line
+inline Options parseCommandLine(const std::vector<std::string> &arguments)
+{
+	Options options;
+
+	for (std::vector<std::string>::size_type i = 0; i < arguments.size(); ++i)
+	{
+		const std::string &argument = arguments[i];
+
+		if (argument == "--filter")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--filter needs an expression");
+			}
+			options.filter = arguments[i];
+		}
+		else if (argument == "--stats")
+		{
+			chooseMode(options, Mode::STATISTICS, argument);
+			options.statistics = true;
+		}
+		else if (argument == "--search")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--search needs a sequence of hex bytes");
+			}
+			chooseMode(options, Mode::SEARCH, argument);
+			options.search.push_back(arguments[i]);
+		}
+		else if (argument == "--diff")
+		{
+			chooseMode(options, Mode::DIFF, argument);
+			options.diff = true;
+		}
+		else if (argument == "--collapse")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--collapse needs the longest period to look for");
+			}
+			chooseMode(options, Mode::COLLAPSE, argument);
+			options.collapse = parseCount(arguments[i], "--collapse");
+		}
+		else if (argument == "--errors")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--errors needs a window size");
+			}
+			chooseMode(options, Mode::ERRORS, argument);
+			options.error_window = parseCount(arguments[i], "--errors");
+		}
+		else if (argument == "--burst")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--burst needs a percentage");
+			}
+			options.burst = parsePercent(arguments[i], "--burst");
+		}
+		else if (argument == "--threads")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--threads needs a thread count");
+			}
+			options.threads = parseCount(arguments[i], "--threads");
+		}
+		else if (argument == "--prefetch")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--prefetch needs a number of files");
+			}
+			options.prefetch = parseCount(arguments[i], "--prefetch");
+		}
+		else if (argument == "--generate")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--generate needs a file to write");
+			}
+			chooseMode(options, Mode::GENERATE, argument);
+			options.generate = arguments[i];
+		}
+		else if (argument == "--size")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--size needs a number of MB");
+			}
+			options.size = parseCount(arguments[i], "--size");
+		}
+		else if (argument == "--mix")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--mix needs the traffic mix");
+			}
+			options.mix = arguments[i];
+		}
+		else if (argument == "--metrics")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--metrics needs a file to write");
+			}
+			options.metrics = arguments[i];
+		}
+		else if (argument == "--prometheus")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--prometheus needs a file to write");
+			}
+			options.prometheus = arguments[i];
+		}
+		else if (argument == "--bench")
+		{
+			chooseMode(options, Mode::BENCH, argument);
+			options.bench = true;
+		}
+		else if (argument == "--pipeline")
+		{
+			chooseMode(options, Mode::PIPELINE, argument);
+			options.pipeline = true;
+		}
+		else if (argument == "--archive")
+		{
+			chooseMode(options, Mode::ARCHIVE, argument);
+			options.archive = true;
+		}
+		else if (argument == "--index")
+		{
+			chooseMode(options, Mode::INDEX, argument);
+			options.index = true;
+		}
+		else if (argument == "--sample")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--sample needs its settings, e.g. \"share=1\"");
+			}
+			chooseMode(options, Mode::SAMPLE, argument);
+			options.sample = arguments[i];
+		}
+		else if (argument == "--window")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--window needs a range of bytes or messages, or bytes to look around");
+			}
+			chooseMode(options, Mode::WINDOW, argument);
+			options.window = arguments[i];
+		}
+		else if (argument == "--daemon")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--daemon needs a socket to listen on");
+			}
+			chooseMode(options, Mode::DAEMON, argument);
+			options.daemon = arguments[i];
+		}
+		else if (argument == "--live")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--live needs a device to read");
+			}
+			options.live = arguments[i];
+		}
+		else if (argument == "--gap")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--gap needs a number of milliseconds");
+			}
+			options.gap = parseCount(arguments[i], "--gap");
+		}
+		else if (argument == "--stitch")
+		{
+			options.stitch = true;
+		}
+		else if (argument == "--meters")
+		{
+			chooseMode(options, Mode::METERS, argument);
+			options.meters = true;
+		}
+		else if (argument == "--series")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--series needs a file to write");
+			}
+			options.series = arguments[i];
+		}
+		else if (argument == "--link")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--link needs the link settings, e.g. \"baud=19200\"");
+			}
+			chooseMode(options, Mode::LINK, argument);
+			options.link = arguments[i];
+		}
+		else if (argument == "--checkpoint")
+		{
+			if (++i == arguments.size())
+			{
+				throw std::invalid_argument("--checkpoint needs a file to keep the checkpoint in");
+			}
+			options.checkpoint = arguments[i];
+		}
+		else if ((argument.size() > 1) && (argument[0] == '-'))
+		{
+			throw std::invalid_argument("Unknown option '" + argument + "'");
+		}
+		else
+		{
+			options.filenames.push_back(argument);
+		}
+	}
+
+	// The options that change how a mode runs, and the modes each works with
+	requireMode(options, !options.filter.empty(), "--filter",
+		{ Mode::LIST, Mode::STATISTICS, Mode::SEARCH, Mode::DIFF, Mode::COLLAPSE, Mode::PIPELINE, Mode::BENCH, Mode::WINDOW, Mode::METERS, Mode::SAMPLE });
+	requireMode(options, !options.live.empty(), "--live", { Mode::LIST, Mode::METERS });
+	requireMode(options, !options.checkpoint.empty(), "--checkpoint", { Mode::LIST, Mode::STATISTICS, Mode::METERS });
+	requireMode(options, options.stitch, "--stitch", { Mode::LIST, Mode::STATISTICS, Mode::METERS, Mode::LINK });
+	requireMode(options, !options.series.empty(), "--series", { Mode::METERS });
+
+	if (!options.live.empty() && (!options.filenames.empty() || !options.checkpoint.empty() || options.stitch || !options.series.empty()))
+	{
+		throw std::invalid_argument("--live only decodes its device - it can't be combined with captures, --checkpoint, --stitch or --series");
+	}
+
+	if (options.stitch && !options.checkpoint.empty())
+	{
+		throw std::invalid_argument("--stitch can't be combined with --checkpoint");
+	}
+
+	if (((options.mode == Mode::GENERATE) || (options.mode == Mode::DAEMON)) && !options.filenames.empty())
+	{
+		throw std::invalid_argument(options.mode_option + " doesn't read captures - it can't be given any");
+	}
+
+#ifdef _WIN32
+	if (options.mode == Mode::DAEMON)
+	{
+		throw std::invalid_argument("--daemon needs Unix domain sockets - it isn't available on Windows");
+	}
+	if (!options.live.empty())
+	{
+		throw std::invalid_argument("--live needs POSIX terminals - it isn't available on Windows");
+	}
+#endif
+
+	if ((options.mode == Mode::DIFF) && (options.filenames.size() != 2))
+	{
+		throw std::invalid_argument("--diff needs two captures");
+	}
+
+	if (options.filenames.empty())
+	{
+		options.filenames.push_back("Test_Comment.log");
+	}
+
+	return options;
+}
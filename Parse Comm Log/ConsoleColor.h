@@ -2,6 +2,8 @@
 
 #pragma once
 #include <iostream>
+
+#ifdef _WIN32
 #include <windows.h>
 
 inline std::ostream& blue(std::ostream &s)
@@ -56,4 +58,42 @@ operator<<(std::basic_ostream<_Elem, _Traits>& i, color& c)
 	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
 	SetConsoleTextAttribute(hStdout, c.m_color);
 	return i;
-}
\ No newline at end of file
+}
+
+#else
+// Anywhere else the colours are ANSI escape sequences in the text itself - and only when the text is
+// going straight to a terminal, so files and pipes get plain text
+#include <cstdio>
+#include <unistd.h>
+
+inline bool colorConsole(std::ostream &s)
+{
+	static const bool terminal = (isatty(fileno(stdout)) != 0);
+	return terminal && (&s == &std::cout);
+}
+
+inline std::ostream& blue(std::ostream &s)
+{
+	return colorConsole(s) ? (s << "\033[1;36m") : s;
+}
+
+inline std::ostream& red(std::ostream &s)
+{
+	return colorConsole(s) ? (s << "\033[1;31m") : s;
+}
+
+inline std::ostream& green(std::ostream &s)
+{
+	return colorConsole(s) ? (s << "\033[1;32m") : s;
+}
+
+inline std::ostream& yellow(std::ostream &s)
+{
+	return colorConsole(s) ? (s << "\033[1;33m") : s;
+}
+
+inline std::ostream& white(std::ostream &s)
+{
+	return colorConsole(s) ? (s << "\033[0m") : s;
+}
+#endif
@@ -0,0 +1,423 @@
+#pragma once
+
+// Decode daemon - keeps the decoder warm (the string tables built, threads started) and serves decode
+// requests over a Unix domain socket, so tooling that decodes many small captures doesn't pay for a
+// new process each time. Connections are queued as they are accepted and served by a pool of threads,
+// a connection at a time, for as many requests as the client sends on it. Every request is framed and
+// filtered with its own framer, filter and statistics so requests never share any state
+//
+//   request  := "FILE " mode " " path "\n"
+//             | "BYTES " mode " " length "\n" <length bytes of capture>
+//   mode     := ( "list" | "stats" ) [ ":" filter ]
+//   response := "OK " length "\n" <length bytes of text>
+//             | "ERROR " reason "\n"
+//
+// e.g. "FILE list:lp=72 /captures/IGT_1419032367.log" lists just the long poll 72s of the capture, as
+// the command line would list them. A capture may also be a compact archive (see Archive.hpp). BYTES
+// takes captures of up to 256 MB - a bigger one is decoded from its file. Only built where there are
+// Unix domain sockets
+
+#ifndef _WIN32
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Archive.hpp"
+#include "Filter.hpp"
+#include "Framer.hpp"
+#include "ParseCommLog.hpp"
+#include "Statistics.hpp"
+
+class DecodeDaemon
+{
+public:
+	// Loads a whole capture for a FILE request - called on the pool threads
+	std::function<std::vector<BYTE>(const std::string &)> load;
+
+	// Parses a framed message - called on the pool threads, so it mustn't touch anything shared
+	std::function<void(Message &)> parse;
+
+	// Purpose: Listen on the socket and serve requests with a pool of threads. Only returns by throwing
+	// std::runtime_error when the socket can't be set up or stops accepting
+	void serve(const std::string &path, std::size_t threads)
+	{
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			throw std::runtime_error("Socket path is too long");
+		}
+		std::memcpy(address.sun_path, path.c_str(), path.size());
+
+		// A client going away mid-response shows up as a failed send rather than killing the daemon
+		signal(SIGPIPE, SIG_IGN);
+
+		int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+		{
+			throw std::runtime_error("Socket could not be created");
+		}
+
+		removeStaleSocket(path, address);
+		if ((bind(listener, (sockaddr *)&address, sizeof(address)) != 0) || (listen(listener, SOMAXCONN) != 0))
+		{
+			close(listener);
+			throw std::runtime_error("Socket could not be bound to '" + path + "'");
+		}
+
+		for (std::size_t i = 0; i != threads; ++i)
+		{
+			std::thread(&DecodeDaemon::work, this).detach();
+		}
+		std::cout << "Serving decode requests on " << path << " with " << threads << " threads" << std::endl;
+
+		for (;;)
+		{
+			int connection = accept(listener, nullptr, nullptr);
+			if (connection < 0)
+			{
+				if ((errno == EINTR) || (errno == ECONNABORTED))
+				{
+					continue;
+				}
+				close(listener);
+				throw std::runtime_error("Socket stopped accepting connections");
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				connections.push_back(connection);
+			}
+			wake.notify_one();
+		}
+	}
+
+	// Purpose: Remove a socket left behind by a daemon that has gone. Throws std::runtime_error if another
+	// daemon is still serving on it, or the path is something other than a socket
+	static void removeStaleSocket(const std::string &path, const sockaddr_un &address)
+	{
+		struct stat status;
+		if (lstat(path.c_str(), &status) != 0)
+		{
+			return; // Nothing there
+		}
+		if (!S_ISSOCK(status.st_mode))
+		{
+			throw std::runtime_error("'" + path + "' is already there and isn't a socket");
+		}
+
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (probe < 0)
+		{
+			throw std::runtime_error("Socket could not be created");
+		}
+		int connected = connect(probe, (const sockaddr *)&address, sizeof(address));
+		int error = errno;
+		close(probe);
+
+		if (connected == 0)
+		{
+			throw std::runtime_error("Another daemon is already serving on '" + path + "'");
+		}
+		if (error != ECONNREFUSED)
+		{
+			throw std::runtime_error("Socket '" + path + "' could not be checked : " + std::strerror(error));
+		}
+		unlink(path.c_str()); // Nobody listening - left behind by an earlier daemon
+	}
+
+	// Purpose: Decode a capture the way the request's mode asks. Throws std::invalid_argument on a bad
+	// mode and std::runtime_error on a bad capture
+	std::string decode(const std::string &mode, std::vector<BYTE> &bytes)
+	{
+		std::string::size_type colon = mode.find(':');
+		std::string kind = mode.substr(0, colon);
+		if ((kind != "list") && (kind != "stats"))
+		{
+			throw std::invalid_argument("Unknown mode '" + kind + "'");
+		}
+		bool list = (kind == "list");
+
+		MessageFilter filter;
+		filter.set((colon == std::string::npos) ? std::string() : mode.substr(colon + 1));
+
+		if (isCompactArchive(bytes))
+		{
+			bytes = expandArchive(bytes);
+		}
+
+		std::ostringstream text;
+		MessageStatistics statistics;
+
+		MessageFramer framer;
+		framer.saved = [&](Message &message)
+		{
+			if (!filter.matches(message))
+			{
+				return;
+			}
+
+			if (list)
+			{
+				parse(message);
+				text << message << '\n';
+			}
+			else
+			{
+				statistics.add(message);
+			}
+		};
+
+		framer.startOfStream();
+		for (std::size_t i = 0, size = ((bytes.size() / 2) * 2); i != size; i += 2)
+		{
+			framer.searchForMessage(StatusAndData(bytes[i], bytes[i + 1]), i);
+		}
+		framer.endOfStream();
+
+		if (!list)
+		{
+			statistics.report(text);
+		}
+		return text.str();
+	}
+
+private:
+	// Buffered reads and whole writes on an accepted connection
+	class Connection
+	{
+	public:
+		explicit Connection(int socket)
+			:socket(socket),
+			buffer(BUFFER_BYTES)
+		{
+		}
+
+		~Connection()
+		{
+			close(socket);
+		}
+
+		// Purpose: Read up to the next newline. False once the client has gone, or on a line too long to
+		// be a request
+		bool readLine(std::string &line)
+		{
+			line.clear();
+			for (;;)
+			{
+				for (; start != end; ++start)
+				{
+					if (buffer[start] == '\n')
+					{
+						++start;
+						return true;
+					}
+					line += buffer[start];
+				}
+
+				if ((line.size() > MAX_LINE) || !fill())
+				{
+					return false;
+				}
+			}
+		}
+
+		// Purpose: Read exactly count bytes. False if the client goes first
+		bool readBytes(std::size_t count, std::vector<BYTE> &bytes)
+		{
+			bytes.resize(count);
+			std::size_t done = 0;
+			while (done != count)
+			{
+				if ((start == end) && !fill())
+				{
+					return false;
+				}
+
+				std::size_t take = ((end - start) < (count - done)) ? (end - start) : (count - done);
+				std::memcpy(bytes.data() + done, buffer.data() + start, take);
+				start += take;
+				done += take;
+			}
+			return true;
+		}
+
+		bool write(const std::string &text)
+		{
+			for (std::size_t done = 0; done != text.size();)
+			{
+				ssize_t sent = send(socket, text.data() + done, text.size() - done, 0);
+				if (sent < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return false;
+				}
+				done += (std::size_t)sent;
+			}
+			return true;
+		}
+
+	private:
+		bool fill()
+		{
+			for (;;)
+			{
+				ssize_t received = recv(socket, buffer.data(), buffer.size(), 0);
+				if (received < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				start = 0;
+				end = (received > 0) ? (std::size_t)received : 0;
+				return received > 0;
+			}
+		}
+
+		static const std::size_t BUFFER_BYTES = { 64 * 1024 };
+		static const std::size_t MAX_LINE = { 64 * 1024 };
+
+		int socket;
+		std::vector<char> buffer;
+		std::size_t start = { 0 };
+		std::size_t end = { 0 };
+	};
+
+	// Purpose: Serve queued connections, one at a time, for as long as the daemon runs
+	void work()
+	{
+		for (;;)
+		{
+			int socket;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return !connections.empty(); });
+				socket = connections.front();
+				connections.pop_front();
+			}
+
+			try
+			{
+				Connection connection(socket);
+				while (serveRequest(connection))
+				{
+				}
+			}
+			catch (std::exception const&)
+			{
+				// Dropping the connection - a worker must never take the daemon down with it
+			}
+		}
+	}
+
+	// Purpose: Read a request and answer it. False when the connection is finished with - the client has
+	// gone, or has sent something the next request can't be found after
+	bool serveRequest(Connection &connection)
+	{
+		std::string line;
+		if (!connection.readLine(line))
+		{
+			return false;
+		}
+
+		std::string::size_type first_space = line.find(' ');
+		std::string::size_type second_space = (first_space == std::string::npos) ? first_space : line.find(' ', first_space + 1);
+		if (second_space == std::string::npos)
+		{
+			return connection.write("ERROR Expected FILE <mode> <path> or BYTES <mode> <length>\n");
+		}
+
+		std::string command = line.substr(0, first_space);
+		std::string mode = line.substr(first_space + 1, second_space - first_space - 1);
+		std::string argument = line.substr(second_space + 1);
+
+		std::vector<BYTE> bytes;
+		if (command == "BYTES")
+		{
+			std::size_t used = 0;
+			unsigned long long length = 0;
+			try
+			{
+				length = std::stoull(argument, &used);
+			}
+			catch (std::exception const&)
+			{
+				used = 0;
+			}
+			if (argument.empty() || (used != argument.size()))
+			{
+				// The capture's bytes can't be skipped without knowing how many there are
+				connection.write("ERROR BYTES needs the length of the capture\n");
+				return false;
+			}
+			if (length > MAX_CAPTURE_BYTES)
+			{
+				connection.write("ERROR BYTES can send at most " + std::to_string(MAX_CAPTURE_BYTES) + " bytes - send a bigger capture with FILE\n");
+				return false;
+			}
+
+			try
+			{
+				if (!connection.readBytes((std::size_t)length, bytes))
+				{
+					return false;
+				}
+			}
+			catch (std::exception const& e)
+			{
+				// e.g. out of memory - the capture's bytes are still to come, so the connection can't go on
+				connection.write(std::string("ERROR ") + e.what() + "\n");
+				return false;
+			}
+		}
+		else if (command != "FILE")
+		{
+			return connection.write("ERROR Unknown request '" + command + "'\n");
+		}
+
+		try
+		{
+			if (command == "FILE")
+			{
+				bytes = load(argument);
+			}
+
+			std::string text = decode(mode, bytes);
+			return connection.write("OK " + std::to_string(text.size()) + "\n" + text);
+		}
+		catch (std::exception const& e)
+		{
+			return connection.write(std::string("ERROR ") + e.what() + "\n");
+		}
+	}
+
+	// Biggest capture a client may stream in one request - it is held whole while it is decoded, for
+	// each request being served at once
+	static const unsigned long long MAX_CAPTURE_BYTES = { 256ULL * 1024 * 1024 };
+
+	std::deque<int> connections;
+	std::mutex mutex;
+	std::condition_variable wake;
+};
+
+DecodeDaemon decode_daemon;
+
+#endif // _WIN32
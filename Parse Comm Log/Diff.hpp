@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+// Compare two captures message by message. Each framed message is reduced to a hash of its raw
+// status/data bytes and the two sequences of hashes are aligned with Myers' O(ND) difference
+// algorithm (linear space version), so near identical captures diff in close to linear time
+
+// Just enough of a framed message to compare it and to find it again in the capture
+struct MessageRecord
+{
+	std::uint64_t hash;
+	std::uint64_t offset;
+	std::uint32_t length;       // Status/data pairs
+	Direction direction;
+	LastRequest request;
+};
+
+enum class DiffType
+{
+	DELETED,    // Only in the first capture
+	INSERTED,   // Only in the second capture
+	CHANGED     // Replaced - a deleted message paired with an inserted one
+};
+
+struct DiffEdit
+{
+	DiffType type;
+	std::size_t a_index;    // First capture message (DELETED, CHANGED)
+	std::size_t b_index;    // Second capture message (INSERTED, CHANGED)
+};
+
+class CaptureDiff
+{
+public:
+	// Purpose: Select which capture the framed messages are being added to (0 or 1)
+	void selectCapture(int capture) { current = capture; }
+
+	void add(Message &message)
+	{
+		MessageRecord record = { hashMessage(message), message.offset, (std::uint32_t)message.raw_status_and_data_bytes.size(), message.direction, message.request };
+		records[current].push_back(record);
+	}
+
+	MessageRecord &record(int capture, std::size_t index) { return records[capture][index]; }
+
+	// Purpose: Align the two captures and return what changed, in order
+	std::vector<DiffEdit> compare()
+	{
+		std::vector<Step> steps;
+		diffBox(0, 0, records[0].size(), records[1].size(), steps);
+
+		// Steps that follow on from each other without a matching message in between form a hunk. Inside
+		// a hunk deleted and inserted messages are paired up as changed messages
+		std::vector<DiffEdit> edits;
+		for (std::size_t start = 0; start != steps.size(); )
+		{
+			std::size_t end = start + 1;
+			while ((end != steps.size()) && (steps[end].a == steps[end - 1].a + steps[end - 1].deleted) && (steps[end].b == steps[end - 1].b + !steps[end - 1].deleted))
+			{
+				++end;
+			}
+
+			std::vector<std::size_t> deleted;
+			std::vector<std::size_t> inserted;
+			for (std::size_t i = start; i != end; ++i)
+			{
+				if (steps[i].deleted)
+				{
+					deleted.push_back(steps[i].a);
+				}
+				else
+				{
+					inserted.push_back(steps[i].b);
+				}
+			}
+
+			std::size_t i = 0;
+			for (; (i != deleted.size()) && (i != inserted.size()); ++i)
+			{
+				DiffEdit edit = { DiffType::CHANGED, deleted[i], inserted[i] };
+				edits.push_back(edit);
+			}
+			for (std::size_t d = i; d != deleted.size(); ++d)
+			{
+				DiffEdit edit = { DiffType::DELETED, deleted[d], 0 };
+				edits.push_back(edit);
+			}
+			for (std::size_t n = i; n != inserted.size(); ++n)
+			{
+				DiffEdit edit = { DiffType::INSERTED, 0, inserted[n] };
+				edits.push_back(edit);
+			}
+
+			start = end;
+		}
+
+		return edits;
+	}
+
+private:
+	// A single deleted (a) or inserted (b) message at position a, b of the edit path
+	struct Step
+	{
+		std::size_t a;
+		std::size_t b;
+		bool deleted;
+	};
+
+	bool same(std::size_t a, std::size_t b) { return records[0][a].hash == records[1][b].hash; }
+
+	// Purpose: Emit the steps that turn records[0][left, right) into records[1][top, bottom)
+	void diffBox(std::size_t left, std::size_t top, std::size_t right, std::size_t bottom, std::vector<Step> &steps)
+	{
+		// Common prefix and suffix need no searching
+		while ((left < right) && (top < bottom) && same(left, top))
+		{
+			++left;
+			++top;
+		}
+		while ((left < right) && (top < bottom) && same(right - 1, bottom - 1))
+		{
+			--right;
+			--bottom;
+		}
+
+		std::size_t x1, y1, x2, y2;
+		if ((left == right) || (top == bottom) || !middleSnake(left, top, right, bottom, x1, y1, x2, y2))
+		{
+			// Nothing in common (or too different to be worth finding what is) - delete one, insert the other
+			for (std::size_t a = left; a != right; ++a)
+			{
+				Step step = { a, top, true };
+				steps.push_back(step);
+			}
+			for (std::size_t b = top; b != bottom; ++b)
+			{
+				Step step = { right, b, false };
+				steps.push_back(step);
+			}
+			return;
+		}
+
+		diffBox(left, top, x1, y1, steps);
+		diffBox(x1, y1, x2, y2, steps);
+		diffBox(x2, y2, right, bottom, steps);
+	}
+
+	// Purpose: Find the middle snake of the box - the edit and run of matches the shortest path crosses
+	// halfway. Returns false if the box needs more than MAX_EDIT_COST edits
+	bool middleSnake(std::size_t left, std::size_t top, std::size_t right, std::size_t bottom,
+		std::size_t &x1, std::size_t &y1, std::size_t &x2, std::size_t &y2)
+	{
+		std::int64_t width = right - left;
+		std::int64_t height = bottom - top;
+		std::int64_t delta = width - height;
+		std::int64_t max = (width + height + 1) / 2;
+		if (max > MAX_EDIT_COST)
+		{
+			max = MAX_EDIT_COST;
+		}
+
+		// Furthest x reached forwards on diagonal k and furthest y reached backwards on diagonal c
+		std::int64_t origin = max + 1;
+		std::vector<std::int64_t> forward((2 * max) + 3, 0);
+		std::vector<std::int64_t> backward((2 * max) + 3, 0);
+		forward[origin + 1] = left;
+		backward[origin + 1] = bottom;
+
+		for (std::int64_t d = 0; d <= max; ++d)
+		{
+			for (std::int64_t k = d; k >= -d; k -= 2)
+			{
+				std::int64_t c = k - delta;
+				std::int64_t x, px;
+				if ((k == -d) || ((k != d) && (forward[origin + k - 1] < forward[origin + k + 1])))
+				{
+					px = x = forward[origin + k + 1];
+				}
+				else
+				{
+					px = forward[origin + k - 1];
+					x = px + 1;
+				}
+
+				std::int64_t y = top + (x - left) - k;
+				std::int64_t py = ((d == 0) || (x != px)) ? y : y - 1;
+
+				while ((x < (std::int64_t)right) && (y < (std::int64_t)bottom) && same((std::size_t)x, (std::size_t)y))
+				{
+					++x;
+					++y;
+				}
+				forward[origin + k] = x;
+
+				if ((delta & 1) && (c >= -(d - 1)) && (c <= d - 1) && (y >= backward[origin + c]))
+				{
+					x1 = (std::size_t)px;
+					y1 = (std::size_t)py;
+					x2 = (std::size_t)x;
+					y2 = (std::size_t)y;
+					return true;
+				}
+			}
+
+			for (std::int64_t c = d; c >= -d; c -= 2)
+			{
+				std::int64_t k = c + delta;
+				std::int64_t y, py;
+				if ((c == -d) || ((c != d) && (backward[origin + c - 1] > backward[origin + c + 1])))
+				{
+					py = y = backward[origin + c + 1];
+				}
+				else
+				{
+					py = backward[origin + c - 1];
+					y = py - 1;
+				}
+
+				std::int64_t x = left + (y - top) + k;
+				std::int64_t px = ((d == 0) || (y != py)) ? x : x + 1;
+
+				while ((x > (std::int64_t)left) && (y > (std::int64_t)top) && same((std::size_t)(x - 1), (std::size_t)(y - 1)))
+				{
+					--x;
+					--y;
+				}
+				backward[origin + c] = y;
+
+				if (!(delta & 1) && (k >= -d) && (k <= d) && (x <= forward[origin + k]))
+				{
+					x1 = (std::size_t)x;
+					y1 = (std::size_t)y;
+					x2 = (std::size_t)px;
+					y2 = (std::size_t)py;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	// Boxes needing more edits than this are reported as wholly deleted and inserted
+	static const std::int64_t MAX_EDIT_COST = { 1 << 14 };
+
+	std::vector<MessageRecord> records[2];
+	int current = { 0 };
+};
+
+CaptureDiff capture_diff;
@@ -0,0 +1,575 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+// Filter expression - evaluated on the raw status/data bytes as soon as a message has been framed
+// so messages that don't match are never saved, parsed or formatted
+//
+//   expression := clause { ',' clause }                all clauses must match
+//   clause     := [ '!' ] key '=' value { '/' value }  any one value may match, '!' inverts the clause
+//
+//   dir=rx/tx/comment               direction
+//   type=bp/gp/lp/chirp             kind of poll (a response takes the kind of the request it answers)
+//   addr=01                         address (a response takes the address of the request it answers)
+//   lp=72                           long poll code (requests and the responses to them)
+//   exc=11                          exception code returned to a general poll
+//   err=overrun/framing/break/any   line errors flagged in the status bytes
+//   bytes=0172                      sequence of data bytes anywhere in the message
+//
+// e.g. "lp=72,addr=01", "dir=tx,!exc=00" or "err=any"
+
+enum class FilterKey
+{
+	DIRECTION,
+	TYPE,
+	ADDRESS,
+	LONG_POLL,
+	EXCEPTION,
+	ERRORS,
+	BYTES
+};
+
+// Values for the TYPE key - the LastRequest values plus a chirp
+const BYTE CHIRP_TYPE = { 4 };
+
+// Values for the ERRORS key - one bit per line error
+const BYTE OVERRUN_ERROR_FLAG = { 0x01 };
+const BYTE FRAMING_ERROR_FLAG = { 0x02 };
+const BYTE BREAK_ERROR_FLAG = { 0x04 };
+
+// Purpose: Convert hex digits to a byte e.g. "7F". Throws std::invalid_argument if it isn't one
+inline BYTE parseHexByte(const std::string &value)
+{
+	std::size_t used = 0;
+	unsigned long number = 0;
+	try
+	{
+		number = std::stoul(value, &used, 16);
+	}
+	catch (std::exception const&)
+	{
+		used = 0;
+	}
+
+	if (value.empty() || (used != value.size()) || (number > 0xFF))
+	{
+		throw std::invalid_argument("'" + value + "' is not a hex byte");
+	}
+
+	return (BYTE)number;
+}
+
+// Purpose: Convert pairs of hex digits to a sequence of bytes e.g. "0172AB"
+inline std::vector<BYTE> parseHexSequence(const std::string &value)
+{
+	if (value.empty() || (value.size() % 2))
+	{
+		throw std::invalid_argument("Byte sequence '" + value + "' must be an even number of hex digits");
+	}
+
+	std::vector<BYTE> sequence;
+	for (std::string::size_type i = 0; i != value.size(); i += 2)
+	{
+		sequence.push_back(parseHexByte(value.substr(i, 2)));
+	}
+	return sequence;
+}
+
+struct FilterClause
+{
+	FilterKey key;
+	bool negate = { false };
+	std::bitset<0x100> accept;             // Single byte keys - every value that satisfies the clause
+	std::vector<std::vector<BYTE>> bytes;  // BYTES key - the sequences to look for
+};
+
+// The fields of a framed message the clauses are evaluated against. Fields that don't apply to the
+// message (e.g. an exception code in a request) are left invalid and never match
+struct FilterFields
+{
+	BYTE direction = { 0 };
+	BYTE type = { 0 };
+	BYTE address = { 0 };
+	BYTE long_poll = { 0 };
+	BYTE exception = { 0 };
+	BYTE errors = { 0 };
+
+	bool type_valid = { false };
+	bool address_valid = { false };
+	bool long_poll_valid = { false };
+	bool exception_valid = { false };
+};
+
+// Every value each field took across a run of framed messages (e.g. a chunk of a capture) - enough to
+// tell that a filter can't match any of them without framing them again. Invalid fields aren't recorded,
+// as they never match
+struct FilterFieldsSeen
+{
+	std::bitset<0x100> direction;
+	std::bitset<0x100> type;
+	std::bitset<0x100> address;
+	std::bitset<0x100> long_poll;
+	std::bitset<0x100> exception;
+	std::bitset<0x100> errors;
+
+	void add(const FilterFields &fields)
+	{
+		direction.set(fields.direction);
+		errors.set(fields.errors);
+		if (fields.type_valid)
+		{
+			type.set(fields.type);
+		}
+		if (fields.address_valid)
+		{
+			address.set(fields.address);
+		}
+		if (fields.long_poll_valid)
+		{
+			long_poll.set(fields.long_poll);
+		}
+		if (fields.exception_valid)
+		{
+			exception.set(fields.exception);
+		}
+	}
+};
+
+class MessageFilter
+{
+public:
+	// Purpose: Build the filter from an expression (see above). Throws std::invalid_argument on a bad expression
+	void set(const std::string &expression)
+	{
+		clauses.clear();
+
+		std::string::size_type start = 0;
+		while (start <= expression.size())
+		{
+			std::string::size_type end = expression.find(',', start);
+			if (end == std::string::npos)
+			{
+				end = expression.size();
+			}
+
+			std::string clause = expression.substr(start, end - start);
+			if (!clause.empty())
+			{
+				clauses.push_back(parseClause(clause));
+			}
+
+			start = end + 1;
+		}
+	}
+
+	bool active() const { return !clauses.empty(); }
+
+	// Purpose: Decide if a framed message is wanted. Must see every framed message, in order, so the
+	// address and long poll code of the last request are known when its response arrives
+	bool matches(Message &message)
+	{
+		if (!active())
+		{
+			return true;
+		}
+
+		FilterFields fields = extractFields(message);
+
+		for (auto &clause : clauses)
+		{
+			if (matchClause(clause, message, fields) == clause.negate)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Purpose: Pull the fields the clauses test out of the raw status/data bytes. Like matches, must see
+	// every framed message, in order
+	FilterFields extractFields(Message &message)
+	{
+		FilterFields fields;
+		StatusAndData &first = message.raw_status_and_data_bytes[0];
+
+		fields.direction = (BYTE)message.direction;
+
+		for (auto &status_and_data : message.raw_status_and_data_bytes)
+		{
+			if (status_and_data.status.overrun_error)
+			{
+				fields.errors |= OVERRUN_ERROR_FLAG;
+			}
+			if (status_and_data.status.framing_error)
+			{
+				fields.errors |= FRAMING_ERROR_FLAG;
+			}
+			if (status_and_data.status.break_error)
+			{
+				fields.errors |= BREAK_ERROR_FLAG;
+			}
+		}
+
+		switch (message.direction)
+		{
+		case Direction::RX:
+			// A request - remember who it was sent to and what was asked for its response
+			context_address_valid = false;
+			context_long_poll_valid = false;
+
+			if (first.addressByte())
+			{
+				fields.type_valid = true;
+				fields.address_valid = true;
+
+				if (first.broadcastPoll())
+				{
+					fields.type = BP_REQUEST;
+					fields.address = 0;
+				}
+				else if (first.generalPoll())
+				{
+					fields.type = GP_REQUEST;
+					fields.address = first.data & ~POLL_MASK;
+				}
+				else
+				{
+					fields.type = LP_REQUEST;
+					fields.address = first.data;
+
+					if (message.raw_status_and_data_bytes.size() > 1)
+					{
+						fields.long_poll_valid = true;
+						fields.long_poll = message.raw_status_and_data_bytes[1].data;
+					}
+				}
+
+				context_address_valid = fields.address_valid;
+				context_address = fields.address;
+				context_long_poll_valid = fields.long_poll_valid;
+				context_long_poll = fields.long_poll;
+			}
+			break;
+
+		case Direction::TX:
+			// A response - takes the address and long poll code of the request it answers
+			fields.type_valid = true;
+			fields.address_valid = context_address_valid;
+			fields.address = context_address;
+
+			if (first.addressByte())
+			{
+				fields.type = CHIRP_TYPE;
+			}
+			else
+			{
+				fields.type = (BYTE)message.request;
+
+				if (message.request == GP_REQUEST)
+				{
+					fields.exception_valid = true;
+					fields.exception = first.data;
+				}
+				else if (message.request == LP_REQUEST)
+				{
+					fields.long_poll_valid = context_long_poll_valid;
+					fields.long_poll = context_long_poll;
+				}
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		return fields;
+	}
+
+	// Purpose: Decide if the filter could match any of a run of messages from the values their fields
+	// took. False only when one of the clauses matches none of them - a clause that is inverted or looks
+	// for bytes can't be ruled out this way
+	bool couldMatch(const FilterFieldsSeen &seen) const
+	{
+		for (auto &clause : clauses)
+		{
+			if (clause.negate)
+			{
+				continue;
+			}
+
+			const std::bitset<0x100> *values = nullptr;
+			switch (clause.key)
+			{
+			case FilterKey::DIRECTION:
+				values = &seen.direction;
+				break;
+
+			case FilterKey::TYPE:
+				values = &seen.type;
+				break;
+
+			case FilterKey::ADDRESS:
+				values = &seen.address;
+				break;
+
+			case FilterKey::LONG_POLL:
+				values = &seen.long_poll;
+				break;
+
+			case FilterKey::EXCEPTION:
+				values = &seen.exception;
+				break;
+
+			case FilterKey::ERRORS:
+				values = &seen.errors;
+				break;
+
+			default:
+				break;
+			}
+
+			if (values && (clause.accept & *values).none())
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Purpose: Write what the filter knows about the last request, for a checkpoint
+	void save(std::ostream &o) const
+	{
+		o << (int)context_address << ' ' << (int)context_long_poll << ' ' << context_address_valid << ' ' << context_long_poll_valid << '\n';
+	}
+
+	// Purpose: Carry on from what save wrote. Throws std::runtime_error if it can't be read
+	void restore(std::istream &i)
+	{
+		int address = 0;
+		int long_poll = 0;
+		if (!(i >> address >> long_poll >> context_address_valid >> context_long_poll_valid))
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+		context_address = (BYTE)address;
+		context_long_poll = (BYTE)long_poll;
+	}
+
+private:
+	FilterClause parseClause(std::string clause)
+	{
+		FilterClause filter_clause;
+
+		if (clause[0] == '!')
+		{
+			filter_clause.negate = true;
+			clause.erase(0, 1);
+		}
+
+		std::string::size_type equals = clause.find('=');
+		if (equals == std::string::npos)
+		{
+			throw std::invalid_argument("Filter clause '" + clause + "' is missing '='");
+		}
+
+		std::string key = clause.substr(0, equals);
+		if (key == "dir")
+		{
+			filter_clause.key = FilterKey::DIRECTION;
+		}
+		else if (key == "type")
+		{
+			filter_clause.key = FilterKey::TYPE;
+		}
+		else if (key == "addr")
+		{
+			filter_clause.key = FilterKey::ADDRESS;
+		}
+		else if (key == "lp")
+		{
+			filter_clause.key = FilterKey::LONG_POLL;
+		}
+		else if (key == "exc")
+		{
+			filter_clause.key = FilterKey::EXCEPTION;
+		}
+		else if (key == "err")
+		{
+			filter_clause.key = FilterKey::ERRORS;
+		}
+		else if (key == "bytes")
+		{
+			filter_clause.key = FilterKey::BYTES;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown filter key '" + key + "'");
+		}
+
+		std::string values = clause.substr(equals + 1);
+		std::string::size_type start = 0;
+		while (start <= values.size())
+		{
+			std::string::size_type end = values.find('/', start);
+			if (end == std::string::npos)
+			{
+				end = values.size();
+			}
+
+			addValue(filter_clause, values.substr(start, end - start));
+
+			start = end + 1;
+		}
+
+		return filter_clause;
+	}
+
+	void addValue(FilterClause &clause, const std::string &value)
+	{
+		switch (clause.key)
+		{
+		case FilterKey::DIRECTION:
+			if (value == "rx")
+			{
+				clause.accept.set(Direction::RX);
+			}
+			else if (value == "tx")
+			{
+				clause.accept.set(Direction::TX);
+			}
+			else if (value == "comment")
+			{
+				clause.accept.set(Direction::COMMENT);
+			}
+			else
+			{
+				throw std::invalid_argument("Unknown direction '" + value + "'");
+			}
+			break;
+
+		case FilterKey::TYPE:
+			if (value == "bp")
+			{
+				clause.accept.set(BP_REQUEST);
+			}
+			else if (value == "gp")
+			{
+				clause.accept.set(GP_REQUEST);
+			}
+			else if (value == "lp")
+			{
+				clause.accept.set(LP_REQUEST);
+			}
+			else if (value == "chirp")
+			{
+				clause.accept.set(CHIRP_TYPE);
+			}
+			else
+			{
+				throw std::invalid_argument("Unknown poll type '" + value + "'");
+			}
+			break;
+
+		case FilterKey::ADDRESS:
+		case FilterKey::LONG_POLL:
+		case FilterKey::EXCEPTION:
+			clause.accept.set(parseHexByte(value));
+			break;
+
+		case FilterKey::ERRORS:
+		{
+			BYTE wanted;
+			if (value == "overrun")
+			{
+				wanted = OVERRUN_ERROR_FLAG;
+			}
+			else if (value == "framing")
+			{
+				wanted = FRAMING_ERROR_FLAG;
+			}
+			else if (value == "break")
+			{
+				wanted = BREAK_ERROR_FLAG;
+			}
+			else if (value == "any")
+			{
+				wanted = OVERRUN_ERROR_FLAG | FRAMING_ERROR_FLAG | BREAK_ERROR_FLAG;
+			}
+			else
+			{
+				throw std::invalid_argument("Unknown line error '" + value + "'");
+			}
+
+			// Accept every combination of errors that includes one of the wanted errors
+			for (unsigned int errors = 0; errors != 0x100; ++errors)
+			{
+				if (errors & wanted)
+				{
+					clause.accept.set(errors);
+				}
+			}
+		}
+		break;
+
+		case FilterKey::BYTES:
+			clause.bytes.push_back(parseHexSequence(value));
+			break;
+		}
+	}
+
+	static bool matchClause(FilterClause &clause, Message &message, FilterFields &fields)
+	{
+		switch (clause.key)
+		{
+		case FilterKey::DIRECTION:
+			return clause.accept.test(fields.direction);
+
+		case FilterKey::TYPE:
+			return fields.type_valid && clause.accept.test(fields.type);
+
+		case FilterKey::ADDRESS:
+			return fields.address_valid && clause.accept.test(fields.address);
+
+		case FilterKey::LONG_POLL:
+			return fields.long_poll_valid && clause.accept.test(fields.long_poll);
+
+		case FilterKey::EXCEPTION:
+			return fields.exception_valid && clause.accept.test(fields.exception);
+
+		case FilterKey::ERRORS:
+			return clause.accept.test(fields.errors);
+
+		case FilterKey::BYTES:
+			for (auto &sequence : clause.bytes)
+			{
+				auto found = std::search(message.raw_status_and_data_bytes.begin(), message.raw_status_and_data_bytes.end(),
+					sequence.begin(), sequence.end(),
+					[](const StatusAndData &status_and_data, BYTE data) { return status_and_data.data == data; });
+
+				if (found != message.raw_status_and_data_bytes.end())
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		return false;
+	}
+
+	std::vector<FilterClause> clauses;
+
+	// The last request seen - so a response can be matched on the address and long poll it answers
+	BYTE context_address = { 0 };
+	BYTE context_long_poll = { 0 };
+	bool context_address_valid = { false };
+	bool context_long_poll_valid = { false };
+};
+
+MessageFilter message_filter;
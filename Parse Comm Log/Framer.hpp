@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include "ParseCommLog.hpp"
+
+// Assembles a stream of status/data pairs into messages. Everything the framer knows about the stream
+// is kept in the framer, so any number of streams can be framed at once - one framer each. Each
+// message is stamped with the request it answers, so it can be parsed on its own in any order, and
+// handed to saved as soon as it is complete
+
+// Purpose: Work out what kind of request (from the system) a message is from its first byte
+inline LastRequest classifyRequest(Message &message)
+{
+	StatusAndData &first = message.raw_status_and_data_bytes[0];
+
+	if (!first.addressByte())
+	{
+		return UNKNOWN_REQUEST;
+	}
+	else if (first.broadcastPoll())
+	{
+		return BP_REQUEST;
+	}
+	else if (first.generalPoll())
+	{
+		return GP_REQUEST;
+	}
+	else if (first.longPoll())
+	{
+		return LP_REQUEST;
+	}
+
+	return UNKNOWN_REQUEST;
+}
+
+class MessageFramer
+{
+public:
+	// Called with each message as it is completed
+	std::function<void(Message &)> saved;
+
+	// Purpose: Finds the messages in the byte stream and hands each one on as it is completed
+	void searchForMessage(StatusAndData status_and_data, std::uint64_t offset)
+	{
+		if (status_and_data.commentByte())
+		{
+			// This is a comment byte
+			if (current_message.direction == Direction::UNKNOWN)
+			{
+				// Catching the middle of a COMMENT
+				current_message.startNew(Direction::COMMENT, NO_START_OF_MESSAGE_DETECTED, offset);
+			}
+			else if (current_message.direction != Direction::COMMENT)
+			{
+				// Implied start of message
+				saveMessage(current_message); // Last message is complete save it
+				current_message.startNew(Direction::COMMENT, NO_START_OF_MESSAGE_DETECTED, offset);
+			}
+			// else it's another byte in a comment
+		}
+		else if (status_and_data.tx())
+		{
+			// Byte TX'd. If last byte was RX'd this implies start of new message
+			if (current_message.direction == Direction::UNKNOWN)
+			{
+				// Catching the middle of a TX'd message
+				current_message.startNew(Direction::TX, NO_START_OF_MESSAGE_DETECTED, offset);
+			}
+			else if (current_message.direction != Direction::TX)
+			{
+				// Implied start of message
+				saveMessage(current_message); // Last message is complete save it
+				current_message.startNew(Direction::TX, START_OF_MESSAGE_DETECTED, offset);
+			}
+			// else it's another byte in a TX message
+		}
+		else if (status_and_data.rx() && status_and_data.addressByte())
+		{
+			// Message RX'd with clear start of message
+			if (current_message.direction != Direction::UNKNOWN)
+			{
+				saveMessage(current_message); // Last message is complete save it
+			}
+
+			current_message.startNew(Direction::RX, START_OF_MESSAGE_DETECTED, offset);
+		}
+		else if (status_and_data.rx())
+		{
+			// Byte RX'd. If last byte was not RX'd this implies start of a new message
+			if (current_message.direction == Direction::UNKNOWN)
+			{
+				// Catching the middle of an RX'd message
+				current_message.startNew(Direction::RX, NO_START_OF_MESSAGE_DETECTED, offset);
+			}
+			else if (current_message.direction != Direction::RX)
+			{
+				// Implied start of message
+				saveMessage(current_message); // Last message is complete save it
+				current_message.startNew(Direction::RX, NO_START_OF_MESSAGE_DETECTED, offset);
+			}
+			// else it's another byte in an RX message
+		}
+
+//#define __ACTUALLY_PARSE_IT__
+#ifdef __ACTUALLY_PARSE_IT__
+		// Add the translated raw bytes
+		std::ostringstream ss;
+		ss << ' ' << status_and_data;
+		current_message.data += ss.str();
+#endif
+
+#define __SAVE_BYTES__
+#ifdef __SAVE_BYTES__
+		// Add the raw bytes
+		current_message.raw_status_and_data_bytes.push_back(status_and_data);
+#endif
+	}
+
+	// Purpose: Called before the first byte of a capture - nothing is known about what came before it
+	void startOfStream()
+	{
+		current_message.startNew(Direction::UNKNOWN, NO_START_OF_MESSAGE_DETECTED, 0);
+		last_request = UNKNOWN_REQUEST;
+		last_request_offset = NO_REQUEST_OFFSET;
+	}
+
+	// Purpose: Called after the last byte - the message in progress has nothing after it to imply its end
+	void endOfStream()
+	{
+		endOfMessage();
+	}
+
+	// Purpose: Called when a live line has gone quiet - nothing more is coming for the message in
+	// progress, so it is complete without waiting for the next one to start
+	void endOfMessage()
+	{
+		if (current_message.direction != Direction::UNKNOWN)
+		{
+			saveMessage(current_message);
+			current_message.startNew(Direction::UNKNOWN, NO_START_OF_MESSAGE_DETECTED, 0);
+		}
+	}
+
+	bool inMessage() const { return current_message.direction != Direction::UNKNOWN; }
+
+	// Purpose: Write everything the framer knows about the stream so far, for a checkpoint
+	void save(std::ostream &o) const
+	{
+		o << last_request << ' ' << last_request_offset << ' '
+			<< current_message.direction << ' ' << current_message.start_of_message_detected << ' ' << current_message.offset << ' '
+			<< current_message.raw_status_and_data_bytes.size();
+		for (auto &status_and_data : current_message.raw_status_and_data_bytes)
+		{
+			o << ' ' << (int)status_and_data.status.raw_status << ' ' << (int)status_and_data.data;
+		}
+		o << '\n';
+	}
+
+	// Purpose: Carry on from what save wrote. Throws std::runtime_error if it can't be read
+	void restore(std::istream &i)
+	{
+		int request = 0;
+		int direction = 0;
+		bool start_of_message_detected = false;
+		std::uint64_t offset = 0;
+		std::size_t size = 0;
+		i >> request >> last_request_offset >> direction >> start_of_message_detected >> offset >> size;
+		if (!i || (request > LP_REQUEST) || (direction > COMMENT))
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+
+		last_request = (LastRequest)request;
+		current_message.startNew((Direction)direction, start_of_message_detected, offset);
+		for (std::size_t n = 0; n != size; ++n)
+		{
+			int status = 0;
+			int data = 0;
+			if (!(i >> status >> data))
+			{
+				throw std::runtime_error("Checkpoint is corrupt");
+			}
+			current_message.raw_status_and_data_bytes.push_back(StatusAndData((BYTE)status, (BYTE)data));
+		}
+	}
+
+private:
+	// Purpose: Stamp a complete message with the request it answers and hand it on
+	void saveMessage(Message &message)
+	{
+		switch (message.direction)
+		{
+		case Direction::RX:
+			last_request = classifyRequest(message);
+			last_request_offset = message.offset;
+			break;
+
+		case Direction::TX:
+			message.request = last_request;
+			message.request_offset = last_request_offset;
+			break;
+
+		default:
+			break;
+		}
+
+		saved(message);
+	}
+
+	Message current_message;
+
+	// Tracked as each request completes so every response can be stamped with the request it answers
+	LastRequest last_request = { UNKNOWN_REQUEST };
+	std::uint64_t last_request_offset = { NO_REQUEST_OFFSET };
+};
+
+MessageFramer message_framer;
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+// Synthetic captures in the status/data pair format, for benchmarking. The traffic is a random mix of
+// general polls, long polls and comments, with a share of the general polls answered by an exception
+// and a share of the RX'd bytes flagged with a line error. The same mix and seed always give the same
+// capture, so runs of different versions can be compared
+//
+//   mix := setting { ',' setting }
+//
+//   gp=60        weight of general polls (and their responses)
+//   lp=30        weight of long polls (and their responses)
+//   comment=10   weight of comments
+//   exc=5        percent of general polls answered with an exception rather than 00
+//   err=0.1      percent of RX'd bytes with an overrun, framing or break error
+//   seed=1       random number seed
+
+struct GeneratorMix
+{
+	double general_polls = { 60 };
+	double long_polls = { 30 };
+	double comments = { 10 };
+	double exceptions = { 5 };
+	double errors = { 0.1 };
+	unsigned int seed = { 1 };
+};
+
+// Purpose: Build a mix from its settings (see above). Throws std::invalid_argument on a bad mix
+inline GeneratorMix parseMix(const std::string &mix)
+{
+	GeneratorMix generator_mix;
+
+	std::string::size_type start = 0;
+	while (start < mix.size())
+	{
+		std::string::size_type end = mix.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = mix.size();
+		}
+
+		std::string setting = mix.substr(start, end - start);
+		std::string::size_type equals = setting.find('=');
+		if (equals == std::string::npos)
+		{
+			throw std::invalid_argument("Mix setting '" + setting + "' is missing '='");
+		}
+
+		std::string key = setting.substr(0, equals);
+		std::string value = setting.substr(equals + 1);
+		std::size_t used = 0;
+		double number = 0;
+		try
+		{
+			number = std::stod(value, &used);
+		}
+		catch (std::exception const&)
+		{
+			used = 0;
+		}
+		if (value.empty() || (used != value.size()) || (number < 0))
+		{
+			throw std::invalid_argument("Mix setting '" + setting + "' needs a number that isn't negative");
+		}
+
+		if (key == "gp")
+		{
+			generator_mix.general_polls = number;
+		}
+		else if (key == "lp")
+		{
+			generator_mix.long_polls = number;
+		}
+		else if (key == "comment")
+		{
+			generator_mix.comments = number;
+		}
+		else if (key == "exc")
+		{
+			generator_mix.exceptions = number;
+		}
+		else if (key == "err")
+		{
+			generator_mix.errors = number;
+		}
+		else if (key == "seed")
+		{
+			generator_mix.seed = (unsigned int)number;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown mix setting '" + key + "'");
+		}
+
+		start = end + 1;
+	}
+
+	if ((generator_mix.general_polls + generator_mix.long_polls + generator_mix.comments) <= 0)
+	{
+		throw std::invalid_argument("Mix needs at least one of gp, lp or comment");
+	}
+
+	return generator_mix;
+}
+
+// Purpose: SAS CRC (CRC-16/KERMIT) of a run of data bytes
+inline std::uint16_t sasCrc(const std::vector<BYTE> &data)
+{
+	std::uint16_t crc = 0;
+	for (auto byte : data)
+	{
+		std::uint16_t q = (crc ^ byte) & 0x0F;
+		crc = (crc >> 4) ^ (q * 0x1081);
+		q = (crc ^ (byte >> 4)) & 0x0F;
+		crc = (crc >> 4) ^ (q * 0x1081);
+	}
+	return crc;
+}
+
+class CaptureGenerator
+{
+public:
+	explicit CaptureGenerator(const GeneratorMix &mix)
+		:mix(mix),
+		random(mix.seed)
+	{
+	}
+
+	// Purpose: Write at least size bytes of capture - always whole messages
+	void write(std::ostream &o, std::uint64_t size)
+	{
+		std::uint64_t written = 0;
+		while (written < size)
+		{
+			pairs.clear();
+			while (pairs.size() < BLOCK_BYTES)
+			{
+				addExchange();
+			}
+
+			o.write((const char *)pairs.data(), pairs.size());
+			written += pairs.size();
+		}
+	}
+
+private:
+	// Purpose: Add a request and its response, or a comment
+	void addExchange()
+	{
+		double total = mix.general_polls + mix.long_polls + mix.comments;
+		double pick = uniform(random) * total;
+
+		if (pick < mix.general_polls)
+		{
+			addRequest({ (BYTE)(POLL_MASK | ADDRESS) });
+
+			BYTE exception = 0x00;
+			if ((uniform(random) * 100) < mix.exceptions)
+			{
+				exception = EXCEPTION_CODES[random() % (sizeof(EXCEPTION_CODES) / sizeof(EXCEPTION_CODES[0]))];
+			}
+			addResponse({ exception });
+		}
+		else if (pick < mix.general_polls + mix.long_polls)
+		{
+			BYTE code = LONG_POLL_CODES[random() % (sizeof(LONG_POLL_CODES) / sizeof(LONG_POLL_CODES[0]))];
+
+			std::vector<BYTE> request = { ADDRESS, code };
+			addRequest(withCrc(request));
+
+			std::vector<BYTE> response = { ADDRESS, code };
+			std::size_t length = random() % (MAX_RESPONSE_DATA + 1);
+			for (std::size_t i = 0; i != length; ++i)
+			{
+				response.push_back((BYTE)random());
+			}
+			addResponse(withCrc(response));
+		}
+		else
+		{
+			std::size_t length = 1 + (random() % MAX_COMMENT);
+			for (std::size_t i = 0; i != length; ++i)
+			{
+				addPair(COMMENT_STATUS, (BYTE)(' ' + (random() % ('~' - ' '))));
+			}
+		}
+	}
+
+	void addRequest(const std::vector<BYTE> &data)
+	{
+		for (std::vector<BYTE>::size_type i = 0; i != data.size(); ++i)
+		{
+			// The wakeup (parity) bit marks the address byte
+			BYTE status = RX_STATUS | (i ? 0 : ADDRESS_STATUS);
+			if ((uniform(random) * 100) < mix.errors)
+			{
+				status |= ERROR_STATUS[random() % (sizeof(ERROR_STATUS) / sizeof(ERROR_STATUS[0]))];
+			}
+			addPair(status, data[i]);
+		}
+	}
+
+	void addResponse(const std::vector<BYTE> &data)
+	{
+		for (auto byte : data)
+		{
+			addPair(TX_STATUS, byte);
+		}
+	}
+
+	static std::vector<BYTE> withCrc(std::vector<BYTE> data)
+	{
+		std::uint16_t crc = sasCrc(data);
+		data.push_back((BYTE)(crc & 0xFF));
+		data.push_back((BYTE)(crc >> 8));
+		return data;
+	}
+
+	void addPair(BYTE status, BYTE data)
+	{
+		pairs.push_back(status);
+		pairs.push_back(data);
+	}
+
+	static const BYTE ADDRESS = { 0x01 };
+
+	static const BYTE TX_STATUS = { 0x00 };
+	static const BYTE RX_STATUS = { 0x01 };
+	static const BYTE COMMENT_STATUS = { 0x02 };
+	static const BYTE ADDRESS_STATUS = { 0x20 };
+	static const BYTE ERROR_STATUS[3];
+	static const BYTE EXCEPTION_CODES[6];
+	static const BYTE LONG_POLL_CODES[8];
+
+	static const std::size_t MAX_RESPONSE_DATA = { 32 };
+	static const std::size_t MAX_COMMENT = { 60 };
+
+	// Capture is built and written this much at a time
+	static const std::size_t BLOCK_BYTES = { 1 << 20 };
+
+	GeneratorMix mix;
+	std::mt19937 random;
+	std::uniform_real_distribution<double> uniform;
+	std::vector<BYTE> pairs;
+};
+
+const BYTE CaptureGenerator::ERROR_STATUS[3] = { 0x10, 0x40, 0x80 };  // Overrun, framing, break
+const BYTE CaptureGenerator::EXCEPTION_CODES[6] = { 0x11, 0x12, 0x13, 0x14, 0x51, 0x7C };
+const BYTE CaptureGenerator::LONG_POLL_CODES[8] = { 0x0F, 0x19, 0x1A, 0x1B, 0x1C, 0x1F, 0x54, 0x72 };
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Archive.hpp"
+#include "Filter.hpp"
+#include "ParseCommLog.hpp"
+
+// Capture index - for each fixed size chunk of a capture, every value the filter's fields took in the
+// messages that start in it: directions, kinds of poll, addresses, long poll codes, exception codes and
+// line errors. Written alongside the capture as <file>.pci by --index. A filtered listing of a capture
+// with an index only reads and frames the chunks the filter could match, and skips a capture where
+// none could without opening it. Negated and bytes= clauses can't rule anything out
+//
+// The fields are worked out just as the filter works them out, in capture order, so a chunk is only
+// passed over when none of its messages could have matched. Responses before the first request of a
+// capture answer a request in the capture listed before it, so are noted as answering any address and
+// long poll. The index notes the size of the file it was built from and is ignored if the file has
+// changed size - rebuild it if a capture is replaced
+//
+// A compact archive is indexed the same way, but a query decodes all of it if any chunk could match
+//
+//   header  "PCLI" | version (16 bits) | 0 (16 bits) | chunk bytes (32 bits) | file bytes (64 bits) | chunks (32 bits)
+//   chunk   direction, type and error bitmaps (8 bits each) | address, long poll and exception bitmaps (256 bits each)
+//
+// All numbers are little endian, bitmaps with value 0 in the low bit of the first byte
+
+const char INDEX_MAGIC[4] = { 'P', 'C', 'L', 'I' };
+const std::uint16_t INDEX_VERSION = { 1 };
+
+class CaptureIndex
+{
+public:
+	// Capture bytes in a chunk - small enough that a rare message costs little more than its chunk
+	static const std::uint32_t CHUNK_BYTES = { 256 * 1024 };
+
+	// Purpose: Start indexing a capture
+	void start()
+	{
+		chunks.clear();
+		fields = MessageFilter();
+		seen_request = false;
+	}
+
+	// Purpose: Note the fields of a framed message against the chunk it starts in. Must see every framed
+	// message, in order
+	void add(Message &message)
+	{
+		std::size_t chunk = (std::size_t)(message.offset / CHUNK_BYTES);
+		if (chunk >= chunks.size())
+		{
+			chunks.resize(chunk + 1);
+		}
+		FilterFieldsSeen &seen = chunks[chunk];
+		seen.add(fields.extractFields(message));
+
+		if (message.direction == Direction::RX)
+		{
+			seen_request = true;
+		}
+		else if ((message.direction == Direction::TX) && !seen_request)
+		{
+			// Answers whatever was asked at the end of the capture before
+			seen.address.set();
+			seen.long_poll.set();
+		}
+	}
+
+	// Purpose: Write the index of a file of file_bytes, holding a capture of capture_bytes (fewer, if it
+	// is a compact archive)
+	void write(std::ostream &o, std::uint64_t file_bytes, std::uint64_t capture_bytes)
+	{
+		std::size_t count = (std::size_t)((capture_bytes + CHUNK_BYTES - 1) / CHUNK_BYTES);
+		if (chunks.size() < count)
+		{
+			chunks.resize(count); // Chunks with nothing starting in them
+		}
+
+		std::vector<BYTE> out(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+		putNumber(out, INDEX_VERSION, 2);
+		putNumber(out, 0, 2);
+		putNumber(out, CHUNK_BYTES, 4);
+		putNumber(out, file_bytes, 8);
+		putNumber(out, chunks.size(), 4);
+		for (auto &seen : chunks)
+		{
+			putBits(out, seen.direction, 1);
+			putBits(out, seen.type, 1);
+			putBits(out, seen.errors, 1);
+			putBits(out, seen.address, 32);
+			putBits(out, seen.long_poll, 32);
+			putBits(out, seen.exception, 32);
+		}
+		o.write((const char *)out.data(), out.size());
+	}
+
+	// Purpose: Read the index of a file of file_bytes. False if there isn't one, or it is for a file of
+	// another size. Throws std::runtime_error if it can't be read
+	bool read(const std::string &filename, std::uint64_t file_bytes)
+	{
+		chunks.clear();
+
+		std::ifstream in(filename, std::ios::in | std::ios::binary);
+		if (!in.is_open())
+		{
+			return false;
+		}
+		std::vector<BYTE> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+		if ((bytes.size() < HEADER_BYTES) || (std::memcmp(bytes.data(), INDEX_MAGIC, 4) != 0) || (getNumber(&bytes[4], 2) != INDEX_VERSION) ||
+			(getNumber(&bytes[8], 4) != CHUNK_BYTES))
+		{
+			throw std::runtime_error("Index is corrupt or from another version");
+		}
+		if (getNumber(&bytes[12], 8) != file_bytes)
+		{
+			return false;
+		}
+
+		std::size_t count = (std::size_t)getNumber(&bytes[20], 4);
+		if (bytes.size() != (HEADER_BYTES + (count * CHUNK_INDEX_BYTES)))
+		{
+			throw std::runtime_error("Index is corrupt");
+		}
+
+		chunks.resize(count);
+		const BYTE *in_chunk = &bytes[HEADER_BYTES];
+		for (auto &seen : chunks)
+		{
+			in_chunk = getBits(in_chunk, seen.direction, 1);
+			in_chunk = getBits(in_chunk, seen.type, 1);
+			in_chunk = getBits(in_chunk, seen.errors, 1);
+			in_chunk = getBits(in_chunk, seen.address, 32);
+			in_chunk = getBits(in_chunk, seen.long_poll, 32);
+			in_chunk = getBits(in_chunk, seen.exception, 32);
+		}
+		return true;
+	}
+
+	// Purpose: Runs of chunks the filter could match, as capture offsets [first, second) - adjacent
+	// chunks are merged, so each run is framed once
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> matchingRanges(const MessageFilter &filter, std::uint64_t capture_bytes) const
+	{
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+		for (std::size_t chunk = 0; chunk != chunks.size(); ++chunk)
+		{
+			if (!filter.couldMatch(chunks[chunk]))
+			{
+				continue;
+			}
+
+			std::uint64_t from = (std::uint64_t)chunk * CHUNK_BYTES;
+			std::uint64_t to = from + CHUNK_BYTES;
+			to = (to < capture_bytes) ? to : capture_bytes;
+			if (!ranges.empty() && (ranges.back().second == from))
+			{
+				ranges.back().second = to;
+			}
+			else if (from < to)
+			{
+				ranges.push_back(std::make_pair(from, to));
+			}
+		}
+		return ranges;
+	}
+
+	// Purpose: Chunks the filter could match
+	std::size_t matchingChunks(const MessageFilter &filter) const
+	{
+		std::size_t matching = 0;
+		for (auto &seen : chunks)
+		{
+			if (filter.couldMatch(seen))
+			{
+				++matching;
+			}
+		}
+		return matching;
+	}
+
+	std::size_t chunkCount() const { return chunks.size(); }
+
+private:
+	static void putBits(std::vector<BYTE> &out, const std::bitset<0x100> &bits, std::size_t bytes)
+	{
+		for (std::size_t i = 0; i != bytes; ++i)
+		{
+			BYTE byte = 0;
+			for (std::size_t bit = 0; bit != 8; ++bit)
+			{
+				byte |= (BYTE)(bits[(i * 8) + bit] << bit);
+			}
+			out.push_back(byte);
+		}
+	}
+
+	static const BYTE *getBits(const BYTE *in, std::bitset<0x100> &bits, std::size_t bytes)
+	{
+		for (std::size_t i = 0; i != bytes; ++i)
+		{
+			for (std::size_t bit = 0; bit != 8; ++bit)
+			{
+				bits[(i * 8) + bit] = ((in[i] >> bit) & 1) != 0;
+			}
+		}
+		return in + bytes;
+	}
+
+	static const std::size_t HEADER_BYTES = { 24 };
+	static const std::size_t CHUNK_INDEX_BYTES = { 3 + (3 * 32) };
+
+	std::vector<FilterFieldsSeen> chunks;
+	MessageFilter fields; // Only for its fields, which it must work out for every message
+	bool seen_request = { false };
+};
+
+CaptureIndex capture_index;
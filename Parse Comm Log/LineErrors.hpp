@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define __SSE2_LINE_ERRORS__
+#include <emmintrin.h>
+#endif
+
+// Line error density straight from the status bytes - no messages are framed. The capture is cut
+// into buckets of a quarter of a window and a window slides over them a bucket at a time. Windows
+// where the share of RX'd bytes with an overrun, framing or break error reaches the burst threshold
+// are merged into one anomaly per burst and reported with their offsets
+
+struct LineErrorCounts
+{
+	std::uint64_t overrun = { 0 };
+	std::uint64_t framing = { 0 };
+	std::uint64_t breaks = { 0 };
+	std::uint64_t any = { 0 };       // Bytes with at least one error
+	std::uint64_t received = { 0 };  // RX'd bytes - the only ones that can have errors
+
+	void add(const LineErrorCounts &counts)
+	{
+		overrun += counts.overrun;
+		framing += counts.framing;
+		breaks += counts.breaks;
+		any += counts.any;
+		received += counts.received;
+	}
+};
+
+// Purpose: Number of bits set
+inline unsigned int countBits(unsigned int bits)
+{
+	bits = bits - ((bits >> 1) & 0x55555555);
+	bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+	return (((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+// Purpose: Count the line errors in status/data pairs. Only RX'd bytes that aren't comments count
+inline void countLineErrors(const BYTE *pairs, std::size_t pair_count, LineErrorCounts &counts)
+{
+	std::size_t i = 0;
+
+#ifdef __SSE2_LINE_ERRORS__
+	const __m128i low_byte = _mm_set1_epi16(0x00FF);
+	const __m128i rx_bit = _mm_set1_epi8(0x01);
+	const __m128i bits_321 = _mm_set1_epi8(0x0E);
+	const __m128i comment = _mm_set1_epi8(0x02);
+	const __m128i overrun = _mm_set1_epi8(0x10);
+	const __m128i framing = _mm_set1_epi8(0x40);
+	const __m128i breaks = _mm_set1_epi8((char)0x80);
+	const __m128i errors = _mm_set1_epi8((char)0xD0);
+	const __m128i zero = _mm_setzero_si128();
+
+	// 16 pairs at a time - the status byte is the low byte of each little endian 16 bit lane
+	for (; i + 16 <= pair_count; i += 16)
+	{
+		__m128i low = _mm_loadu_si128((const __m128i *)(pairs + (i * 2)));
+		__m128i high = _mm_loadu_si128((const __m128i *)(pairs + (i * 2) + 16));
+		__m128i status = _mm_packus_epi16(_mm_and_si128(low, low_byte), _mm_and_si128(high, low_byte));
+
+		__m128i rx = _mm_cmpeq_epi8(_mm_and_si128(status, rx_bit), rx_bit);
+		__m128i is_comment = _mm_cmpeq_epi8(_mm_and_si128(status, bits_321), comment);
+		__m128i counted = _mm_andnot_si128(is_comment, rx);
+
+		unsigned int counted_mask = (unsigned int)_mm_movemask_epi8(counted);
+		if (!counted_mask)
+		{
+			continue;
+		}
+
+		counts.received += countBits(counted_mask);
+		counts.overrun += countBits(counted_mask & (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(status, overrun), overrun)));
+		counts.framing += countBits(counted_mask & (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(status, framing), framing)));
+		counts.breaks += countBits(counted_mask & (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(status, breaks), breaks)));
+		counts.any += countBits(counted_mask & ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(status, errors), zero)));
+	}
+#endif
+
+	for (; i != pair_count; ++i)
+	{
+		StatusAndData status_and_data(pairs[i * 2], pairs[(i * 2) + 1]);
+		if (!status_and_data.rx())
+		{
+			continue;
+		}
+
+		Status &status = status_and_data.status;
+		++counts.received;
+		counts.overrun += status.overrun_error;
+		counts.framing += status.framing_error;
+		counts.breaks += status.break_error;
+		counts.any += (status.overrun_error || status.framing_error || status.break_error);
+	}
+}
+
+class LineErrorAnalysis
+{
+public:
+	// Purpose: Set the window size (in capture bytes - two to a status/data pair) and the share of bytes
+	// with errors, in percent, that makes a window part of a burst
+	void set(std::size_t window_bytes, double burst_percent)
+	{
+		// Buckets are whole blocks of 16 pairs so the vector loop never straddles two of them
+		bucket_pairs = (((window_bytes / 2) / BUCKETS_PER_WINDOW) + 15) & ~(std::size_t)15;
+		if (!bucket_pairs)
+		{
+			bucket_pairs = 16;
+		}
+		burst = burst_percent;
+	}
+
+	bool active() const { return bucket_pairs != 0; }
+
+	std::size_t windowBytes() const { return bucket_pairs * BUCKETS_PER_WINDOW * 2; }
+
+	// Purpose: Get ready for a new capture
+	void start()
+	{
+		buckets.clear();
+		bucket_index = 0;
+		bucket = LineErrorCounts();
+		bucket_filled = 0;
+		total = LineErrorCounts();
+		total_pairs = 0;
+		in_burst = false;
+		next_uncounted = 0;
+		bursts.clear();
+	}
+
+	// Purpose: Take the next status/data pairs of the capture
+	void add(const BYTE *pairs, std::size_t pair_count)
+	{
+		while (pair_count)
+		{
+			std::size_t count = bucket_pairs - bucket_filled;
+			if (count > pair_count)
+			{
+				count = pair_count;
+			}
+
+			countLineErrors(pairs, count, bucket);
+			bucket_filled += count;
+			total_pairs += count;
+			pairs += count * 2;
+			pair_count -= count;
+
+			if (bucket_filled == bucket_pairs)
+			{
+				endBucket();
+			}
+		}
+	}
+
+	// Purpose: Finish the capture - the last bucket may be short
+	void finish()
+	{
+		if (bucket_filled)
+		{
+			endBucket();
+		}
+		if (in_burst)
+		{
+			bursts.push_back(current_burst);
+			in_burst = false;
+		}
+	}
+
+	void report(std::ostream &o)
+	{
+		o << std::dec << std::setfill(' ')
+			<< "Line error bursts (" << windowBytes() << " byte windows, " << burst << "% or more of RX'd bytes with errors)" << std::endl;
+
+		for (auto &anomaly : bursts)
+		{
+			o << "  @" << anomaly.start << " to @" << anomaly.end
+				<< "  errors " << anomaly.counts.any
+				<< " (overrun " << anomaly.counts.overrun
+				<< ", framing " << anomaly.counts.framing
+				<< ", break " << anomaly.counts.breaks << ")"
+				<< "  peak " << std::setprecision(3) << anomaly.peak_percent << "%" << std::endl;
+		}
+
+		o << bursts.size() << " bursts, " << total.any << " bytes with errors"
+			<< " (overrun " << total.overrun
+			<< ", framing " << total.framing
+			<< ", break " << total.breaks << ")"
+			<< " in " << total.received << " RX'd bytes of " << total_pairs << std::endl;
+	}
+
+private:
+	struct Bucket
+	{
+		std::uint64_t index;
+		std::uint64_t pairs;
+		LineErrorCounts counts;
+	};
+
+	struct Burst
+	{
+		std::uint64_t start;        // Capture offsets
+		std::uint64_t end;
+		std::uint64_t next_bucket;  // First bucket not yet counted
+		LineErrorCounts counts;
+		double peak_percent;
+	};
+
+	void endBucket()
+	{
+		Bucket finished = { bucket_index++, bucket_filled, bucket };
+		total.add(bucket);
+		bucket = LineErrorCounts();
+		bucket_filled = 0;
+
+		buckets.push_back(finished);
+		if (buckets.size() > BUCKETS_PER_WINDOW)
+		{
+			buckets.erase(buckets.begin());
+		}
+
+		// Slide the window on a bucket
+		std::uint64_t window_received = 0;
+		std::uint64_t window_errors = 0;
+		for (auto &b : buckets)
+		{
+			window_received += b.counts.received;
+			window_errors += b.counts.any;
+		}
+
+		double percent = window_errors ? ((100.0 * window_errors) / window_received) : 0;
+		if (window_errors && (percent >= burst))
+		{
+			if (!in_burst)
+			{
+				// A burst can't start in a bucket the last one already took
+				std::uint64_t first = buckets.front().index;
+				if (first < next_uncounted)
+				{
+					first = next_uncounted;
+				}
+
+				in_burst = true;
+				current_burst.start = offsetOf(first);
+				current_burst.next_bucket = first;
+				current_burst.counts = LineErrorCounts();
+				current_burst.peak_percent = 0;
+			}
+
+			for (auto &b : buckets)
+			{
+				if (b.index >= current_burst.next_bucket)
+				{
+					current_burst.counts.add(b.counts);
+					current_burst.next_bucket = b.index + 1;
+				}
+			}
+			next_uncounted = current_burst.next_bucket;
+			current_burst.end = offsetOf(finished.index) + (finished.pairs * 2);
+			if (percent > current_burst.peak_percent)
+			{
+				current_burst.peak_percent = percent;
+			}
+		}
+		else if (in_burst)
+		{
+			bursts.push_back(current_burst);
+			in_burst = false;
+		}
+	}
+
+	std::uint64_t offsetOf(std::uint64_t index) { return index * bucket_pairs * 2; }
+
+	static const std::size_t BUCKETS_PER_WINDOW = { 4 };
+
+	std::size_t bucket_pairs = { 0 };
+	double burst = { 1.0 };
+
+	std::vector<Bucket> buckets;    // The window - the last BUCKETS_PER_WINDOW buckets
+	std::uint64_t bucket_index = { 0 };
+	LineErrorCounts bucket;         // Bucket being filled
+	std::size_t bucket_filled = { 0 };
+
+	LineErrorCounts total;
+	std::uint64_t total_pairs = { 0 };
+
+	bool in_burst = { false };
+	std::uint64_t next_uncounted = { 0 };  // First bucket after the last burst
+	Burst current_burst;
+	std::vector<Burst> bursts;
+};
+
+LineErrorAnalysis line_error_analysis;
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include "ParseCommLog.hpp"
+
+// Link utilization - how the time on a SAS link is split between general polls, long polls (by
+// code), their responses, chirps and everything else, and how long the general poll cycle to each
+// address takes. Worked out in one pass from the framed messages, so it runs at framing speed over
+// whole batches and archives
+//
+// Captures have no timestamps, so every time here is wire time - the bytes sent, at bits_per_byte
+// bits a byte (SAS sends a start bit, 8 data bits, the wakeup bit and a stop bit) and the baud rate.
+// Idle time can only be known from how long the capture ran - given as span - and the poll cycle is
+// the wire time from one general poll to an address to the next one to it. Against the cycle the
+// host aims for, that shows how many more long polls would fit in each cycle
+//
+//   settings := setting { ',' setting }
+//
+//   baud=19200   link speed
+//   bits=11      bits on the wire a byte
+//   cycle=200    general poll cycle the host aims for, in ms
+//   span=0       seconds the captures cover, to report idle time (0 - not known)
+
+struct LinkSettings
+{
+	double baud = { 19200 };
+	double bits_per_byte = { 11 };
+	double cycle_ms = { 200 };
+	double span = { 0 };
+};
+
+// Purpose: Build the link settings (see above). Throws std::invalid_argument on bad settings
+inline LinkSettings parseLinkSettings(const std::string &settings)
+{
+	LinkSettings link;
+
+	std::string::size_type start = 0;
+	while (start < settings.size())
+	{
+		std::string::size_type end = settings.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = settings.size();
+		}
+
+		std::string setting = settings.substr(start, end - start);
+		std::string::size_type equals = setting.find('=');
+		if (equals == std::string::npos)
+		{
+			throw std::invalid_argument("Link setting '" + setting + "' is missing '='");
+		}
+
+		std::string key = setting.substr(0, equals);
+		std::string value = setting.substr(equals + 1);
+		std::size_t used = 0;
+		double number = 0;
+		try
+		{
+			number = std::stod(value, &used);
+		}
+		catch (std::exception const&)
+		{
+			used = 0;
+		}
+		if (value.empty() || (used != value.size()) || (number < 0) || ((number == 0) && (key != "span")))
+		{
+			throw std::invalid_argument("Link setting '" + setting + "' needs a positive number");
+		}
+
+		if (key == "baud")
+		{
+			link.baud = number;
+		}
+		else if (key == "bits")
+		{
+			link.bits_per_byte = number;
+		}
+		else if (key == "cycle")
+		{
+			link.cycle_ms = number;
+		}
+		else if (key == "span")
+		{
+			link.span = number;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown link setting '" + key + "'");
+		}
+
+		start = end + 1;
+	}
+
+	return link;
+}
+
+class LinkAnalysis
+{
+public:
+	// Purpose: Analyse the link with these settings (see above)
+	void set(const LinkSettings &link_settings)
+	{
+		settings = link_settings;
+		enabled = true;
+	}
+
+	bool active() const { return enabled; }
+
+	// Purpose: Account for a framed message. Must see every framed message, in order - a long poll's
+	// response is put down to the code of the request before it
+	void add(Message &message)
+	{
+		auto &bytes = message.raw_status_and_data_bytes;
+		if ((message.offset < last_offset) || first_message)
+		{
+			// A new capture or stream - the cycles in progress can't be carried into it
+			startOfStream();
+		}
+		first_message = false;
+		last_offset = message.offset;
+
+		if ((message.direction != Direction::RX) && (message.direction != Direction::TX))
+		{
+			return; // Comments are the analyzer's, never on the wire
+		}
+
+		std::uint64_t length = bytes.size();
+		std::uint64_t sent_at = wire_bytes;
+		wire_bytes += length;
+
+		if (message.direction == Direction::RX)
+		{
+			last_long_poll_valid = false;
+
+			if (!bytes[0].addressByte())
+			{
+				other.add(length);
+			}
+			else if (bytes[0].broadcastPoll())
+			{
+				broadcast_polls.add(length);
+			}
+			else if (bytes[0].generalPoll())
+			{
+				general_polls.add(length);
+				addCycle(bytes[0].data & ~POLL_MASK, sent_at);
+			}
+			else if (bytes.size() > 1)
+			{
+				last_long_poll = bytes[1].data;
+				last_long_poll_valid = true;
+				long_poll_requests[last_long_poll].add(length);
+			}
+			else
+			{
+				other.add(length);
+			}
+			return;
+		}
+
+		if (bytes[0].addressByte())
+		{
+			chirps.add(length);
+		}
+		else if (message.request == GP_REQUEST)
+		{
+			general_poll_responses.add(length);
+		}
+		else if ((message.request == LP_REQUEST) && last_long_poll_valid)
+		{
+			long_poll_responses[last_long_poll].add(length);
+		}
+		else if (message.request == BP_REQUEST)
+		{
+			broadcast_polls.add(length); // Nothing should answer a broadcast - kept with it to show up
+		}
+		else
+		{
+			other.add(length);
+		}
+	}
+
+	// Purpose: Report how the link time was spent, the poll cycle and what is left of it
+	void report(std::ostream &o)
+	{
+		double byte_seconds = settings.bits_per_byte / settings.baud;
+		double busy = wire_bytes * byte_seconds;
+
+		LinkTraffic long_polls;
+		LinkTraffic long_poll_answers;
+		for (std::size_t code = 0; code != long_poll_requests.size(); ++code)
+		{
+			long_polls.add(long_poll_requests[code]);
+			long_poll_answers.add(long_poll_responses[code]);
+		}
+
+		// Shares are of the span when it is known, so idle is part of the split - otherwise of the busy time
+		double whole = (settings.span > busy) ? settings.span : busy;
+
+		o << std::dec << std::setfill(' ')
+			<< "Link at " << settings.baud << " baud, " << settings.bits_per_byte << " bits a byte - "
+			<< std::fixed << std::setprecision(3) << (byte_seconds * 1e3) << " ms a byte" << std::endl
+			<< "Wire time " << busy << " s in " << wire_bytes << " bytes";
+		if (settings.span > busy)
+		{
+			o << " of " << settings.span << " s (" << percent(busy, settings.span) << "% busy)";
+		}
+		else if (settings.span > 0)
+		{
+			o << " - more than the span of " << settings.span << " s, so the baud rate or span is wrong";
+		}
+		o << std::endl;
+
+		reportTraffic(o, "GP requests", general_polls, byte_seconds, whole);
+		reportTraffic(o, "GP responses", general_poll_responses, byte_seconds, whole);
+		reportTraffic(o, "LP requests", long_polls, byte_seconds, whole);
+		reportTraffic(o, "LP responses", long_poll_answers, byte_seconds, whole);
+		reportTraffic(o, "BP", broadcast_polls, byte_seconds, whole);
+		reportTraffic(o, "chirps", chirps, byte_seconds, whole);
+		reportTraffic(o, "other", other, byte_seconds, whole);
+		if (settings.span > busy)
+		{
+			o << "  " << std::left << std::setw(14) << "idle" << std::right << std::setw(12) << (settings.span - busy) << " s "
+				<< std::setw(7) << percent(settings.span - busy, whole) << "%" << std::endl;
+		}
+
+		if (long_polls.messages)
+		{
+			o << "Long polls by code (request + response)" << std::endl;
+			for (std::size_t code = 0; code != long_poll_requests.size(); ++code)
+			{
+				LinkTraffic &request = long_poll_requests[code];
+				LinkTraffic &response = long_poll_responses[code];
+				if (!request.messages)
+				{
+					continue;
+				}
+				double seconds = (request.bytes + response.bytes) * byte_seconds;
+				o << "  " << std::setw(10) << request.messages << " x " << long_poll[code]
+					<< " : " << seconds << " s " << percent(seconds, whole) << "%, "
+					<< (seconds * 1e3 / request.messages) << " ms an exchange" << std::endl;
+			}
+		}
+
+		// The cycle over every address, weighted by how many cycles each had
+		PollCycle all;
+		for (std::size_t address = 0; address != cycles.size(); ++address)
+		{
+			all.merge(cycles[address]);
+		}
+
+		if (!all.count)
+		{
+			o << "No general poll cycles - no address was general polled twice in a capture" << std::endl;
+			o.unsetf(std::ios::floatfield);
+			return;
+		}
+
+		o << "General poll cycle (wire time from a general poll to the next one to the same address)" << std::endl;
+		for (std::size_t address = 0; address != cycles.size(); ++address)
+		{
+			if (cycles[address].count)
+			{
+				o << "  address " << std::uppercase << std::hex << std::setfill('0') << std::setw(2) << address
+					<< std::nouppercase << std::dec << std::setfill(' ') << " : ";
+				reportCycle(o, cycles[address], byte_seconds);
+			}
+		}
+		o << "  all        : ";
+		reportCycle(o, all, byte_seconds);
+
+		// What is left of the cycle the host aims for, in long polls of the average exchange seen
+		double used_ms = all.mean * byte_seconds * 1e3;
+		double spare_ms = settings.cycle_ms - used_ms;
+		o << "Cycle budget at " << settings.cycle_ms << " ms : " << used_ms << " ms used, " << spare_ms << " ms spare";
+		if (long_polls.messages && (spare_ms > 0))
+		{
+			double exchange_ms = (long_polls.bytes + long_poll_answers.bytes) * byte_seconds * 1e3 / long_polls.messages;
+			o << " - room for " << (std::uint64_t)(spare_ms / exchange_ms) << " more long polls a cycle (" << exchange_ms << " ms an exchange)";
+		}
+		else if (spare_ms <= 0)
+		{
+			o << " - the cycle is already over budget";
+		}
+		o << std::endl;
+		o.unsetf(std::ios::floatfield);
+	}
+
+private:
+	struct LinkTraffic
+	{
+		std::uint64_t messages = { 0 };
+		std::uint64_t bytes = { 0 };
+
+		void add(std::uint64_t length)
+		{
+			++messages;
+			bytes += length;
+		}
+
+		void add(const LinkTraffic &traffic)
+		{
+			messages += traffic.messages;
+			bytes += traffic.bytes;
+		}
+	};
+
+	// Running mean and variance of the cycle (Welford), in wire bytes
+	struct PollCycle
+	{
+		std::uint64_t count = { 0 };
+		double mean = { 0 };
+		double m2 = { 0 };
+		std::uint64_t minimum = { ~0ULL };
+		std::uint64_t maximum = { 0 };
+
+		void add(std::uint64_t length)
+		{
+			++count;
+			double delta = length - mean;
+			mean += delta / count;
+			m2 += delta * (length - mean);
+			minimum = (length < minimum) ? length : minimum;
+			maximum = (length > maximum) ? length : maximum;
+		}
+
+		// Purpose: Combine with another address's cycles (Chan et al)
+		void merge(const PollCycle &other)
+		{
+			if (!other.count)
+			{
+				return;
+			}
+			std::uint64_t total = count + other.count;
+			double delta = other.mean - mean;
+			m2 += other.m2 + delta * delta * ((double)count * other.count / total);
+			mean += delta * other.count / total;
+			count = total;
+			minimum = (other.minimum < minimum) ? other.minimum : minimum;
+			maximum = (other.maximum > maximum) ? other.maximum : maximum;
+		}
+
+		double deviation() const { return (count > 1) ? std::sqrt(m2 / (count - 1)) : 0; }
+	};
+
+	void startOfStream()
+	{
+		for (auto &sent_at : last_general_poll)
+		{
+			sent_at = NO_POLL;
+		}
+		last_long_poll_valid = false;
+	}
+
+	void addCycle(std::size_t address, std::uint64_t sent_at)
+	{
+		if (last_general_poll[address] != NO_POLL)
+		{
+			cycles[address].add(sent_at - last_general_poll[address]);
+		}
+		last_general_poll[address] = sent_at;
+	}
+
+	static double percent(double part, double whole)
+	{
+		return (whole > 0) ? (part * 100 / whole) : 0;
+	}
+
+	static void reportTraffic(std::ostream &o, const char *name, const LinkTraffic &traffic, double byte_seconds, double whole)
+	{
+		double seconds = traffic.bytes * byte_seconds;
+		o << "  " << std::left << std::setw(14) << name << std::right << std::setw(12) << seconds << " s "
+			<< std::setw(7) << percent(seconds, whole) << "%  " << traffic.messages << " messages" << std::endl;
+	}
+
+	static void reportCycle(std::ostream &o, const PollCycle &cycle, double byte_seconds)
+	{
+		o << cycle.count << " cycles, mean " << (cycle.mean * byte_seconds * 1e3)
+			<< " ms, jitter " << (cycle.deviation() * byte_seconds * 1e3)
+			<< " ms (std dev), " << (cycle.minimum * byte_seconds * 1e3)
+			<< " - " << (cycle.maximum * byte_seconds * 1e3) << " ms" << std::endl;
+	}
+
+	static const std::uint64_t NO_POLL = { ~0ULL };
+
+	LinkSettings settings;
+	bool enabled = { false };
+
+	std::uint64_t wire_bytes = { 0 };
+	LinkTraffic general_polls;
+	LinkTraffic general_poll_responses;
+	LinkTraffic broadcast_polls;
+	LinkTraffic chirps;
+	LinkTraffic other;
+	std::array<LinkTraffic, 0x100> long_poll_requests = {};
+	std::array<LinkTraffic, 0x100> long_poll_responses = {};
+
+	std::array<std::uint64_t, 0x80> last_general_poll = {};  // Wire bytes sent before the last general poll to each address
+	std::array<PollCycle, 0x80> cycles = {};
+	BYTE last_long_poll = { 0 };
+	bool last_long_poll_valid = { false };
+	std::uint64_t last_offset = { 0 };
+	bool first_message = { true };
+};
+
+LinkAnalysis link_analysis;
@@ -0,0 +1,247 @@
+#pragma once
+
+// Live capture - decode the status/data pairs straight from the capture device (a serial port, or a
+// pty that a simulator is writing to) as they arrive, rather than from a capture file afterwards. The
+// device is read without blocking, and each message is shown as soon as it is complete - when the next
+// message starts, or when the line has been quiet for longer than the gap between the bytes of a
+// message. The time from the read that brought in a message's last byte to the message being shown is
+// measured for every message shown, and the spread reported when the device closes or on Ctrl+C
+//
+// Only built where there are POSIX terminals. A serial port is put in raw mode but keeps its speed, so
+// set that first, e.g. "stty -F /dev/ttyUSB0 19200"
+
+#ifndef _WIN32
+
+#include <array>
+#include <boost/chrono.hpp>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Framer.hpp"
+#include "ParseCommLog.hpp"
+
+// Spread of latencies in 10us buckets up to a second - constant memory however long the capture runs
+class LatencyHistogram
+{
+public:
+	void add(double seconds)
+	{
+		std::size_t bucket = (std::size_t)(seconds / BUCKET_SECONDS);
+		if (bucket > BUCKETS)
+		{
+			bucket = BUCKETS;
+		}
+		++counts[bucket];
+		++total;
+		if (seconds > maximum)
+		{
+			maximum = seconds;
+		}
+	}
+
+	std::uint64_t count() const { return total; }
+	double max() const { return maximum; }
+
+	// Purpose: Latency that share (0 to 1) of the samples were no slower than - to the top of its bucket
+	double percentile(double share) const
+	{
+		std::uint64_t wanted = (std::uint64_t)(share * total);
+		if (wanted < (share * total))
+		{
+			++wanted; // Round up - the p99 of 10 samples is the slowest
+		}
+
+		std::uint64_t seen = 0;
+		for (std::size_t bucket = 0; bucket != BUCKETS; ++bucket)
+		{
+			seen += counts[bucket];
+			if ((seen >= wanted) && seen)
+			{
+				double top = (bucket + 1) * BUCKET_SECONDS;
+				return (top < maximum) ? top : maximum;
+			}
+		}
+		return maximum;
+	}
+
+private:
+	static const std::size_t BUCKETS = { 100000 };
+	static const double BUCKET_SECONDS;
+
+	std::array<std::uint64_t, BUCKETS + 1> counts = {}; // The last bucket is everything over a second
+	std::uint64_t total = { 0 };
+	double maximum = { 0 };
+};
+
+const double LatencyHistogram::BUCKET_SECONDS = { 10e-6 };
+
+class LiveCapture
+{
+public:
+	// Shows a complete message if it is wanted - true if it was shown. Its latency includes showing it
+	std::function<bool(Message &)> show;
+
+	~LiveCapture()
+	{
+		if (device >= 0)
+		{
+			close(device);
+		}
+	}
+
+	// Purpose: Open the device to read from without blocking. The line is idle once nothing has arrived
+	// for gap_ms. Throws std::runtime_error if the device can't be used
+	void open(const std::string &name, std::size_t gap_ms)
+	{
+		device = ::open(name.c_str(), O_RDONLY | O_NONBLOCK | O_NOCTTY);
+		if (device < 0)
+		{
+			throw std::runtime_error("Device could not be opened");
+		}
+
+		if (isatty(device))
+		{
+			// Every byte as it arrives - no line editing, echo or translation
+			termios settings;
+			if (tcgetattr(device, &settings) == 0)
+			{
+				cfmakeraw(&settings);
+				settings.c_cc[VMIN] = 1;
+				settings.c_cc[VTIME] = 0;
+				tcsetattr(device, TCSANOW, &settings);
+			}
+		}
+
+		gap = (int)gap_ms;
+	}
+
+	// Purpose: Decode the device until it closes or Ctrl+C. Returns the bytes read
+	std::uint64_t run()
+	{
+		stop_requested = 0;
+		struct sigaction action = {};
+		action.sa_handler = requestStop; // No SA_RESTART, so the wait is interrupted
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+
+		framer.saved = [this](Message &message)
+		{
+			if (show(message))
+			{
+				latency.add(boost::chrono::duration<double>(boost::chrono::steady_clock::now() - last_pair_received).count());
+			}
+		};
+		framer.startOfStream();
+
+		BYTE buffer[READ_BYTES];
+		std::size_t carried = 0; // A status byte whose data byte hasn't arrived yet
+		std::uint64_t offset = 0;
+
+		while (!stop_requested)
+		{
+			// Only a message in progress has a gap to time - otherwise just wait for the next byte
+			pollfd waiting = { device, POLLIN, 0 };
+			int ready = poll(&waiting, 1, (framer.inMessage() && !carried) ? gap : -1);
+			if (ready < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				throw std::runtime_error("Device could not be waited on");
+			}
+			if (ready == 0)
+			{
+				framer.endOfMessage();
+				continue;
+			}
+
+			ssize_t got = read(device, buffer + carried, sizeof(buffer) - carried);
+			if (got < 0)
+			{
+				if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+				{
+					continue;
+				}
+				if (errno == EIO)
+				{
+					break; // The other end of a pty has closed
+				}
+				throw std::runtime_error("Device could not be read");
+			}
+			if (got == 0)
+			{
+				break;
+			}
+
+			boost::chrono::steady_clock::time_point received = boost::chrono::steady_clock::now();
+			std::size_t available = carried + (std::size_t)got;
+			std::size_t pairs_end = (available / 2) * 2;
+			for (std::size_t i = 0; i != pairs_end; i += 2, offset += 2)
+			{
+				framer.searchForMessage(StatusAndData(buffer[i], buffer[i + 1]), offset);
+				last_pair_received = received; // After, so a message completed by this pair is timed from the one before
+			}
+
+			carried = available - pairs_end;
+			if (carried)
+			{
+				buffer[0] = buffer[pairs_end];
+			}
+			bytes_read += (std::uint64_t)got;
+		}
+
+		framer.endOfStream();
+
+		action.sa_handler = SIG_DFL;
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+		return bytes_read;
+	}
+
+	std::uint64_t messagesShown() const { return latency.count(); }
+
+	// Purpose: Report how long messages took to be shown after their last byte was read
+	void report(std::ostream &o)
+	{
+		o << std::dec << std::fixed << std::setprecision(3)
+			<< latency.count() << " messages shown from " << bytes_read << " bytes" << std::endl
+			<< "latency from last byte read to message shown: p50 " << (latency.percentile(0.50) * 1e3)
+			<< " ms, p99 " << (latency.percentile(0.99) * 1e3)
+			<< " ms, max " << (latency.max() * 1e3) << " ms" << std::endl;
+		o.unsetf(std::ios::floatfield);
+	}
+
+private:
+	static void requestStop(int)
+	{
+		stop_requested = 1;
+	}
+
+	// Read at most this much at a time
+	static const std::size_t READ_BYTES = { 4096 };
+
+	static volatile std::sig_atomic_t stop_requested;
+
+	int device = { -1 };
+	int gap = { 5 };
+	MessageFramer framer;
+	boost::chrono::steady_clock::time_point last_pair_received;
+	LatencyHistogram latency;
+	std::uint64_t bytes_read = { 0 };
+};
+
+volatile std::sig_atomic_t LiveCapture::stop_requested = { 0 };
+
+LiveCapture live_capture;
+
+#endif // _WIN32
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// The decoded messages of a capture as a table - one fixed size row per message, and the data bytes of
+// every message one after another in the payload - so they can be handed to other languages as two
+// blocks of memory rather than an object per message (see ParseCommLogPython.cpp). Defines no global
+// state, so a front-end may include it
+//
+// The row layout is part of the interface - MESSAGE_ROW_FORMAT describes it to Python's buffer protocol
+// and has to be kept in step with it
+
+struct MessageRow
+{
+	std::uint64_t offset;    // Offset in the capture of the first status byte
+	std::uint64_t payload;   // Index in the payload of the first data byte
+	std::uint32_t length;    // Status/data pairs
+	std::uint8_t direction;  // Direction
+	std::uint8_t type;       // DescriptionType
+	std::uint8_t code;       // The byte the description was picked by - poll code, long poll code, exception...
+	std::uint8_t address;    // Address the request was sent to, or the response answers (if known)
+	std::uint8_t long_poll;  // Long poll code of the request, or of the request a response answers (if known)
+	std::uint8_t errors;     // Line errors in the message - OVERRUN_ERROR_FLAG, FRAMING_ERROR_FLAG, BREAK_ERROR_FLAG
+	std::uint8_t known;      // Which of address and long_poll are known - ROW_ADDRESS_KNOWN, ROW_LONG_POLL_KNOWN
+	std::uint8_t request;    // LastRequest a response answers
+	std::uint8_t reserved[4];
+};
+
+static_assert(sizeof(MessageRow) == 32, "MessageRow must stay packed as MESSAGE_ROW_FORMAT says");
+
+const std::uint8_t ROW_ADDRESS_KNOWN = { 0x01 };
+const std::uint8_t ROW_LONG_POLL_KNOWN = { 0x02 };
+
+// The row as a PEP 3118 struct - native byte order, no padding but what is spelt out
+const char *const MESSAGE_ROW_FORMAT = { "T{=Q:offset:=Q:payload:=I:length:B:direction:B:type:B:code:B:address:B:long_poll:B:errors:B:known:B:request:4x}" };
+
+struct MessageTable
+{
+	std::vector<MessageRow> rows;
+	std::vector<std::uint8_t> payload;
+};
@@ -0,0 +1,575 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Generator.hpp"
+#include "ParseCommLog.hpp"
+
+// Meter time series - the meters in the responses to the meter long polls (LP 0F, 10-17, 19, 1A,
+// 1C, 1E, 20, 2A, 2B, 2D, 2F, 31-46), decoded from BCD as the responses are framed and kept per
+// address as a series of changes. Only the first reading of each meter is kept whole - after that
+// just how far into the capture and by how much it changed, packed as varints - so a meter that is
+// polled every few seconds for a month costs a few bytes per change, and nothing while it stands
+// still. Responses are only taken when their CRC and layout check out
+//
+// A meter that goes down is a rollback, and is reported with where it happened - unless it was
+// near the top of its range and went to near the bottom, which is the meter rolling over. Current
+// credits (LP 1A, and meter 0C of LP 2F) are a balance rather than a meter, and go up and down with
+// play, so their series are kept but never counted as rolling back or over
+//
+// The meters of each long poll are a series of their own - coin in from LP 1C and coin in from LP 11
+// are not mixed, as the host may poll them at different points in a game
+
+// Purpose: Decode up to 8 bytes of packed BCD (two digits a byte, most significant first). False if
+// any nibble isn't a digit. SWAR - all the digits are combined in pairs, then fours, then eights
+// within one 64 bit word, rather than one at a time
+inline bool decodeBcd(const BYTE *bytes, std::size_t length, std::uint64_t &value)
+{
+	std::uint64_t packed = 0;
+	for (std::size_t i = 0; i != length; ++i)
+	{
+		packed = (packed << 8) | bytes[i];
+	}
+
+	// A nibble over 9 has its top bit set along with one of the two below it
+	if (packed & ((packed << 1) | (packed << 2)) & 0x8888888888888888ULL)
+	{
+		return false;
+	}
+
+	std::uint64_t digits = ((packed >> 4) & 0x0F0F0F0F0F0F0F0FULL) * 10 + (packed & 0x0F0F0F0F0F0F0F0FULL);  // 0-99 a byte
+	digits = ((digits >> 8) & 0x00FF00FF00FF00FFULL) * 100 + (digits & 0x00FF00FF00FF00FFULL);             // 0-9999 a 16 bits
+	digits = ((digits >> 16) & 0x0000FFFF0000FFFFULL) * 10000 + (digits & 0x0000FFFF0000FFFFULL);           // 0-99999999 a 32 bits
+	value = (digits >> 32) * 100000000ULL + (digits & 0xFFFFFFFFULL);
+	return true;
+}
+
+// A meter read from a response
+struct MeterReading
+{
+	BYTE address = { 0 };
+	BYTE poll = { 0 };         // Long poll the meter was sent in answer to
+	std::uint16_t game = { 0 }; // Game number (LP 2D, 2F) - 0 is the whole machine
+	BYTE meter = { 0 };        // Place in the response, or the meter code (LP 2F)
+	std::uint64_t value = { 0 };
+	std::uint64_t modulus = { 0 }; // The meter rolls over to 0 here
+};
+
+// A change in a meter's value
+struct MeterChange
+{
+	std::uint64_t offset = { 0 }; // Offset in the capture of the response
+	MeterReading reading;
+	std::uint64_t previous = { 0 };
+	bool rollback = { false };
+};
+
+class MeterSeries
+{
+public:
+	// Called with each change as it is seen, if set
+	std::function<void(const MeterChange &)> changed;
+
+	// Purpose: Take the meters from a framed message, if it is the response to a meter long poll.
+	// Returns the number of meters that changed
+	std::size_t add(Message &message)
+	{
+		if ((message.direction != Direction::TX) || (message.request != LP_REQUEST) || message.raw_status_and_data_bytes.empty() ||
+			message.raw_status_and_data_bytes[0].addressByte())
+		{
+			return 0;
+		}
+
+		data.clear();
+		for (auto &status_and_data : message.raw_status_and_data_bytes)
+		{
+			data.push_back(status_and_data.data);
+		}
+		if ((data.size() < 2) || !meterPoll(data[1]))
+		{
+			return 0;
+		}
+
+		readings.clear();
+		if (!decodeResponse(data, readings))
+		{
+			++rejected_responses;
+			return 0;
+		}
+		++responses;
+
+		std::size_t changes = 0;
+		for (auto &reading : readings)
+		{
+			changes += addReading(reading, message.offset);
+		}
+		return changes;
+	}
+
+	// Purpose: Report every meter seen, address by address, with any rollbacks
+	void report(std::ostream &o)
+	{
+		o << std::dec << std::setfill(' ')
+			<< "Meters " << tracks.size() << " from " << responses << " responses (" << rejected_responses << " rejected - bad CRC, layout or BCD)" << std::endl;
+
+		for (auto &entry : tracks)
+		{
+			MeterReading reading = readingOf(entry.first);
+			MeterTrack &track = entry.second;
+
+			o << std::uppercase << std::hex << std::setfill('0') << std::setw(2) << (int)reading.address << ' ';
+			describeMeter(o, reading);
+			o << std::nouppercase << std::dec << std::setfill(' ')
+				<< " : " << track.first_value << " -> " << track.last_value
+				<< ", " << track.reads << " reads, " << track.changes << " changes (" << track.deltas.size() << " bytes)";
+			if (track.rollovers)
+			{
+				o << ", " << track.rollovers << " rollovers";
+			}
+			if (!track.rollbacks.empty())
+			{
+				o << ", " << track.rollbacks.size() << " ROLLBACKS";
+			}
+			o << std::endl;
+
+			for (auto &rollback : track.rollbacks)
+			{
+				o << "   rolled back @" << rollback.offset << " from " << rollback.from << " to " << rollback.to << std::endl;
+			}
+		}
+	}
+
+	// Purpose: Write one change, as the live listing shows it
+	static void describe(std::ostream &o, const MeterChange &change)
+	{
+		o << std::uppercase << std::hex << std::setfill('0') << std::setw(2) << (int)change.reading.address << ' ';
+		describeMeter(o, change.reading);
+		o << std::nouppercase << std::dec << std::setfill(' ') << " : " << change.previous << " -> " << change.reading.value;
+		if (change.rollback)
+		{
+			o << " ROLLBACK";
+		}
+		o << " @" << change.offset;
+	}
+
+	// Purpose: Write every series as CSV - the first reading of each meter and every change after it,
+	// rebuilt from the changes kept
+	void writeSeries(std::ostream &o) const
+	{
+		o << "address,poll,game,meter,offset,value\n";
+		for (auto &entry : tracks)
+		{
+			MeterReading reading = readingOf(entry.first);
+			const MeterTrack &track = entry.second;
+			std::uint64_t offset = track.first_offset;
+			std::uint64_t value = track.first_value;
+
+			std::size_t i = 0;
+			while (true)
+			{
+				o << std::uppercase << std::hex << std::setfill('0') << std::setw(2) << (int)reading.address << ','
+					<< std::setw(2) << (int)reading.poll << ',' << std::dec << reading.game << ','
+					<< std::hex << std::setw(2) << (int)reading.meter << ',' << std::dec << offset << ',' << value << '\n';
+				if (i == track.deltas.size())
+				{
+					break;
+				}
+
+				offset += readVarint(track.deltas, i);
+				std::uint64_t zigzag = readVarint(track.deltas, i);
+				std::uint64_t step = (zigzag & 1) ? (track.modulus - (zigzag >> 1) - 1) : (zigzag >> 1); // Back k is forward modulus - k
+				value = (value + step) % track.modulus;
+			}
+		}
+		o << std::nouppercase << std::setfill(' ');
+	}
+
+	// Purpose: Write every series, for a checkpoint
+	void save(std::ostream &o) const
+	{
+		o << responses << ' ' << rejected_responses << ' ' << tracks.size() << '\n';
+		for (auto &entry : tracks)
+		{
+			const MeterTrack &track = entry.second;
+			o << entry.first << ' ' << track.modulus << ' ' << track.first_offset << ' ' << track.first_value << ' '
+				<< track.last_offset << ' ' << track.last_value << ' ' << track.reads << ' ' << track.changes << ' '
+				<< track.rollovers << ' ' << track.deltas.size();
+			for (auto byte : track.deltas)
+			{
+				o << ' ' << (int)byte;
+			}
+			o << ' ' << track.rollbacks.size();
+			for (auto &rollback : track.rollbacks)
+			{
+				o << ' ' << rollback.offset << ' ' << rollback.from << ' ' << rollback.to;
+			}
+			o << '\n';
+		}
+	}
+
+	// Purpose: Carry on from what save wrote. Throws std::runtime_error if it can't be read
+	void restore(std::istream &i)
+	{
+		tracks.clear();
+		std::size_t count = 0;
+		i >> responses >> rejected_responses >> count;
+		for (std::size_t n = 0; i && (n != count); ++n)
+		{
+			std::uint64_t key = 0;
+			MeterTrack track;
+			std::size_t deltas = 0;
+			i >> key >> track.modulus >> track.first_offset >> track.first_value >> track.last_offset >> track.last_value
+				>> track.reads >> track.changes >> track.rollovers >> deltas;
+			for (std::size_t d = 0; i && (d != deltas); ++d)
+			{
+				int byte = 0;
+				i >> byte;
+				track.deltas.push_back((BYTE)byte);
+			}
+
+			std::size_t rollbacks = 0;
+			i >> rollbacks;
+			for (std::size_t r = 0; i && (r != rollbacks); ++r)
+			{
+				MeterRollback rollback;
+				i >> rollback.offset >> rollback.from >> rollback.to;
+				track.rollbacks.push_back(rollback);
+			}
+			tracks[key] = track;
+		}
+		if (!i)
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+	}
+
+private:
+	struct MeterRollback
+	{
+		std::uint64_t offset = { 0 };
+		std::uint64_t from = { 0 };
+		std::uint64_t to = { 0 };
+	};
+
+	struct MeterTrack
+	{
+		std::uint64_t modulus = { 0 };
+		std::uint64_t first_offset = { 0 };
+		std::uint64_t first_value = { 0 };
+		std::uint64_t last_offset = { 0 };  // Of the last change
+		std::uint64_t last_value = { 0 };
+		std::uint64_t reads = { 0 };
+		std::uint64_t changes = { 0 };
+		std::uint64_t rollovers = { 0 };
+		std::vector<BYTE> deltas;           // Varint offset since the last change, then zigzag varint step, for each change
+		std::vector<MeterRollback> rollbacks;
+	};
+
+	// Purpose: Add a meter's reading to its series. Returns 1 if it changed
+	std::size_t addReading(const MeterReading &reading, std::uint64_t offset)
+	{
+		auto found = tracks.find(keyOf(reading));
+		if (found == tracks.end())
+		{
+			MeterTrack &track = tracks[keyOf(reading)];
+			track.modulus = reading.modulus;
+			track.first_offset = track.last_offset = offset;
+			track.first_value = track.last_value = reading.value;
+			track.reads = 1;
+			return 0;
+		}
+
+		MeterTrack &track = found->second;
+		++track.reads;
+		if (reading.value == track.last_value)
+		{
+			return 0;
+		}
+
+		// Stepping back more than half the range is taken as rolling over, forwards
+		std::int64_t step = 0;
+		MeterChange change;
+		if (reading.value > track.last_value)
+		{
+			step = (std::int64_t)(reading.value - track.last_value);
+		}
+		else if (balanceMeter(reading))
+		{
+			step = -(std::int64_t)(track.last_value - reading.value);
+		}
+		else if ((track.last_value - reading.value) > (track.modulus / 2))
+		{
+			step = (std::int64_t)(reading.value + track.modulus - track.last_value);
+			++track.rollovers;
+		}
+		else
+		{
+			step = -(std::int64_t)(track.last_value - reading.value);
+			MeterRollback rollback;
+			rollback.offset = offset;
+			rollback.from = track.last_value;
+			rollback.to = reading.value;
+			track.rollbacks.push_back(rollback);
+			change.rollback = true;
+		}
+
+		writeVarint(track.deltas, offset - track.last_offset);
+		writeVarint(track.deltas, (step < 0) ? ((((std::uint64_t)-(step + 1)) << 1) | 1) : ((std::uint64_t)step << 1));
+		++track.changes;
+
+		change.offset = offset;
+		change.reading = reading;
+		change.previous = track.last_value;
+
+		track.last_offset = offset;
+		track.last_value = reading.value;
+
+		if (changed)
+		{
+			changed(change);
+		}
+		return 1;
+	}
+
+	// Purpose: Pull the meters out of a response (address, poll code, ..., CRC). False if it doesn't
+	// check out
+	static bool decodeResponse(const std::vector<BYTE> &data, std::vector<MeterReading> &readings)
+	{
+		if ((data.size() < 4) || (sasCrc(std::vector<BYTE>(data.begin(), data.end() - 2)) != (data[data.size() - 2] | (data[data.size() - 1] << 8))))
+		{
+			return false;
+		}
+
+		MeterReading reading;
+		reading.address = data[0];
+		reading.poll = data[1];
+		std::size_t end = data.size() - 2; // Before the CRC
+		std::size_t at = 2;
+
+		if (reading.poll == 0x2F)
+		{
+			// Length, game number, then a meter code and its meter for each meter asked for
+			if ((end < 5) || ((std::size_t)data[2] != (end - 3)))
+			{
+				return false;
+			}
+			std::uint64_t game = 0;
+			if (!decodeBcd(&data[3], 2, game))
+			{
+				return false;
+			}
+			reading.game = (std::uint16_t)game;
+
+			for (at = 5; at < end; )
+			{
+				reading.meter = data[at++];
+				std::size_t size = meterCodeSize(reading.meter);
+				if (((at + size) > end) || !readMeter(data, at, size, reading, readings))
+				{
+					return false;
+				}
+				at += size;
+			}
+			return true;
+		}
+
+		if (reading.poll == 0x2D)
+		{
+			std::uint64_t game = 0;
+			if ((end != 8) || !decodeBcd(&data[2], 2, game))
+			{
+				return false;
+			}
+			reading.game = (std::uint16_t)game;
+			at = 4;
+		}
+
+		// Fixed layout - every meter is 4 bytes
+		std::size_t meters = meterCount(reading.poll);
+		if ((end - at) != (meters * 4))
+		{
+			return false;
+		}
+		for (std::size_t meter = 0; meter != meters; ++meter, at += 4)
+		{
+			reading.meter = (BYTE)meter;
+			if (!readMeter(data, at, 4, reading, readings))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool readMeter(const std::vector<BYTE> &data, std::size_t at, std::size_t size, MeterReading &reading, std::vector<MeterReading> &readings)
+	{
+		if (!decodeBcd(&data[at], size, reading.value))
+		{
+			return false;
+		}
+		reading.modulus = (size == 5) ? 10000000000ULL : 100000000ULL;
+		readings.push_back(reading);
+		return true;
+	}
+
+	static bool meterPoll(BYTE poll)
+	{
+		return (poll == 0x2F) || (meterCount(poll) != 0);
+	}
+
+	// Purpose: True for the current credits, which go down as they are played
+	static bool balanceMeter(const MeterReading &reading)
+	{
+		return (reading.poll == 0x1A) || ((reading.poll == 0x2F) && (reading.meter == 0x0C));
+	}
+
+	// Purpose: Meters in the response to a fixed layout meter poll - 0 if it isn't one
+	static std::size_t meterCount(BYTE poll)
+	{
+		switch (poll)
+		{
+		case 0x0F:
+			return 6;
+
+		case 0x19:
+			return 5;
+
+		case 0x1C:
+			return 8;
+
+		case 0x1E:
+			return 6;
+
+		case 0x10:
+		case 0x11:
+		case 0x12:
+		case 0x13:
+		case 0x14:
+		case 0x15:
+		case 0x16:
+		case 0x17:
+		case 0x1A:
+		case 0x20:
+		case 0x2A:
+		case 0x2B:
+		case 0x2D:
+			return 1;
+
+		default:
+			return ((poll >= 0x31) && (poll <= 0x46) && (poll != 0x3D)) ? 1 : 0;
+		}
+	}
+
+	// Purpose: Bytes in an LP 2F meter. The ticket meters in cents and the AFT meters in cents are 5
+	// bytes, the counts 4
+	static std::size_t meterCodeSize(BYTE code)
+	{
+		if ((code >= 0x0D) && (code <= 0x10))
+		{
+			return 5;
+		}
+		if ((code >= 0x80) && (code <= 0xBD) && !(code & 1))
+		{
+			return 5;
+		}
+		return 4;
+	}
+
+	// Purpose: Write what a meter is, e.g. "LP 1C coin in"
+	static void describeMeter(std::ostream &o, const MeterReading &reading)
+	{
+		static const char *const METERS_0F[] = { "cancelled credits", "coin in", "coin out", "drop", "jackpot", "games played" };
+		static const char *const METERS_19[] = { "coin in", "coin out", "drop", "jackpot", "games played" };
+		static const char *const METERS_1C[] = { "coin in", "coin out", "drop", "jackpot", "games played", "games won", "slot door opened", "power reset" };
+		static const char *const METERS_1E[] = { "$1 bills", "$5 bills", "$10 bills", "$20 bills", "$50 bills", "$100 bills" };
+
+		o << "LP " << std::uppercase << std::hex << std::setfill('0') << std::setw(2) << (int)reading.poll << ' ';
+		switch (reading.poll)
+		{
+		case 0x0F:
+			o << METERS_0F[reading.meter];
+			break;
+		case 0x19:
+			o << METERS_19[reading.meter];
+			break;
+		case 0x1C:
+			o << METERS_1C[reading.meter];
+			break;
+		case 0x1E:
+			o << METERS_1E[reading.meter];
+			break;
+		case 0x2F:
+			o << "game " << std::dec << reading.game << " meter " << std::hex << std::setw(2) << (int)reading.meter;
+			break;
+		case 0x2D:
+			o << "game " << std::dec << reading.game << ' ';
+			// Fall through for the meter's name
+		default:
+			{
+				// The poll's own name - "LP 11 - SEND TOTAL COIN IN METER"
+				const std::string &name = long_poll[reading.poll];
+				std::string::size_type dash = name.find(" - ");
+				o << ((dash == std::string::npos) ? name : name.substr(dash + 3));
+			}
+			break;
+		}
+	}
+
+	// Series are kept in address, poll, game, meter order
+	static std::uint64_t keyOf(const MeterReading &reading)
+	{
+		return ((std::uint64_t)reading.address << 40) | ((std::uint64_t)reading.poll << 32) | ((std::uint64_t)reading.game << 8) | reading.meter;
+	}
+
+	static MeterReading readingOf(std::uint64_t key)
+	{
+		MeterReading reading;
+		reading.address = (BYTE)(key >> 40);
+		reading.poll = (BYTE)(key >> 32);
+		reading.game = (std::uint16_t)(key >> 8);
+		reading.meter = (BYTE)key;
+		return reading;
+	}
+
+	static void writeVarint(std::vector<BYTE> &bytes, std::uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			bytes.push_back((BYTE)(value | 0x80));
+			value >>= 7;
+		}
+		bytes.push_back((BYTE)value);
+	}
+
+	static std::uint64_t readVarint(const std::vector<BYTE> &bytes, std::size_t &i)
+	{
+		std::uint64_t value = 0;
+		for (unsigned shift = 0; i != bytes.size(); shift += 7)
+		{
+			BYTE byte = bytes[i++];
+			value |= (std::uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				break;
+			}
+		}
+		return value;
+	}
+
+	std::map<std::uint64_t, MeterTrack> tracks;
+	std::uint64_t responses = { 0 };
+	std::uint64_t rejected_responses = { 0 };
+
+	// Reused for each response, so nothing is allocated once they have grown
+	std::vector<BYTE> data;
+	std::vector<MeterReading> readings;
+};
+
+MeterSeries meter_series;
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Allocations.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Where the time and memory went, stage by stage, for every capture in a run. Written at the end of
+// the run as JSON and/or in the Prometheus text file format so batch runs can be tracked over time
+//
+// CPU time and peak RSS are for the whole process - CPU time is what every thread used while the
+// stage ran, peak RSS is the high water mark when the stage finished. Allocations are the stage's own -
+// made on the thread measuring it, or by the threads working for it (see Allocations.hpp)
+
+// Purpose: CPU time used by the process so far, user and kernel, in seconds
+inline double processCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+	{
+		return 0;
+	}
+
+	ULARGE_INTEGER kernel_time, user_time;
+	kernel_time.LowPart = kernel.dwLowDateTime;
+	kernel_time.HighPart = kernel.dwHighDateTime;
+	user_time.LowPart = user.dwLowDateTime;
+	user_time.HighPart = user.dwHighDateTime;
+	return (kernel_time.QuadPart + user_time.QuadPart) / 1e7; // 100ns units
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + ((usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+#endif
+}
+
+// Purpose: Most memory the process has had resident so far, in bytes
+inline std::uint64_t peakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return (std::uint64_t)usage.ru_maxrss * 1024; // KB
+#endif
+#endif
+}
+
+// Purpose: Quote a string for JSON
+inline std::string jsonString(const std::string &text)
+{
+	std::ostringstream quoted;
+	quoted << '"';
+	for (auto c : text)
+	{
+		switch (c)
+		{
+		case '"':
+			quoted << "\\\"";
+			break;
+		case '\\':
+			quoted << "\\\\";
+			break;
+		case '\n':
+			quoted << "\\n";
+			break;
+		default:
+			if ((unsigned char)c < 0x20)
+			{
+				quoted << "\\u" << std::hex << std::setfill('0') << std::setw(4) << (int)c << std::dec;
+			}
+			else
+			{
+				quoted << c;
+			}
+			break;
+		}
+	}
+	quoted << '"';
+	return quoted.str();
+}
+
+// Purpose: Quote a Prometheus label value
+inline std::string labelValue(const std::string &text)
+{
+	std::string quoted = "\"";
+	for (auto c : text)
+	{
+		if ((c == '"') || (c == '\\'))
+		{
+			quoted += '\\';
+			quoted += c;
+		}
+		else if (c == '\n')
+		{
+			quoted += "\\n";
+		}
+		else
+		{
+			quoted += c;
+		}
+	}
+	return quoted + '"';
+}
+
+class RunMetrics
+{
+public:
+	// Purpose: Following stages are for this capture - added to what it already has if it has been
+	// measured before
+	void startFile(const std::string &filename)
+	{
+		for (current_file = 0; current_file != files.size(); ++current_file)
+		{
+			if (files[current_file].filename == filename)
+			{
+				return;
+			}
+		}
+
+		File file;
+		file.filename = filename;
+		files.push_back(file);
+	}
+
+	// Purpose: Start measuring a stage of the current capture
+	void start(const char *stage)
+	{
+		current.stage = stage;
+		current_allocations = AllocationSnapshot::now();
+		current_cpu = processCpuSeconds();
+		current_start = boost::chrono::steady_clock::now();
+	}
+
+	// Purpose: Finish measuring the stage with how much it got through
+	void stop(std::uint64_t bytes, std::uint64_t messages)
+	{
+		current.wall_seconds = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - current_start).count();
+		current.cpu_seconds = processCpuSeconds() - current_cpu;
+
+		AllocationSnapshot allocations = AllocationSnapshot::now();
+		current.allocations = allocations.count - current_allocations.count;
+		current.allocated_bytes = allocations.bytes - current_allocations.bytes;
+		current.peak_rss_bytes = peakResidentBytes();
+
+		current.bytes = bytes;
+		current.messages = messages;
+
+		if (files.empty())
+		{
+			startFile("");
+		}
+
+		// A stage run more than once for a capture (e.g. once for each part an index picks out) is
+		// reported once, with the totals - each file and stage is one series
+		for (auto &stage : files[current_file].stages)
+		{
+			if (stage.stage == current.stage)
+			{
+				stage.wall_seconds += current.wall_seconds;
+				stage.cpu_seconds += current.cpu_seconds;
+				stage.bytes += current.bytes;
+				stage.messages += current.messages;
+				stage.allocations += current.allocations;
+				stage.allocated_bytes += current.allocated_bytes;
+				stage.peak_rss_bytes = current.peak_rss_bytes; // Only goes up
+				return;
+			}
+		}
+		files[current_file].stages.push_back(current);
+	}
+
+	void writeJson(std::ostream &o)
+	{
+		// The console may still be set up for hex from showing messages
+		o << std::dec << std::nouppercase << std::setprecision(6) << "{" << std::endl
+			<< "  \"files\": [";
+
+		for (std::vector<File>::size_type f = 0; f != files.size(); ++f)
+		{
+			o << (f ? "," : "") << std::endl
+				<< "    { \"file\": " << jsonString(files[f].filename) << ", \"stages\": [";
+
+			std::vector<Stage> &stages = files[f].stages;
+			for (std::vector<Stage>::size_type s = 0; s != stages.size(); ++s)
+			{
+				Stage &stage = stages[s];
+				o << (s ? "," : "") << std::endl
+					<< "      { \"stage\": " << jsonString(stage.stage)
+					<< ", \"wall_seconds\": " << stage.wall_seconds
+					<< ", \"cpu_seconds\": " << stage.cpu_seconds
+					<< ", \"bytes\": " << stage.bytes
+					<< ", \"messages\": " << stage.messages
+					<< ", \"allocations\": " << stage.allocations
+					<< ", \"allocated_bytes\": " << stage.allocated_bytes
+					<< ", \"peak_rss_bytes\": " << stage.peak_rss_bytes << " }";
+			}
+			o << std::endl << "    ] }";
+		}
+
+		o << std::endl << "  ]," << std::endl
+			<< "  \"peak_rss_bytes\": " << peakResidentBytes() << "," << std::endl
+			<< "  \"cpu_seconds\": " << processCpuSeconds() << std::endl
+			<< "}" << std::endl;
+	}
+
+	void writePrometheus(std::ostream &o)
+	{
+		o << std::dec << std::nouppercase << std::setprecision(15); // Counts are written as doubles - keep them whole
+		writeMetric(o, "stage_wall_seconds", "Wall time spent in a stage", [](Stage &stage) { return stage.wall_seconds; });
+		writeMetric(o, "stage_cpu_seconds", "Process CPU time used while a stage ran", [](Stage &stage) { return stage.cpu_seconds; });
+		writeMetric(o, "stage_bytes", "Capture bytes a stage processed", [](Stage &stage) { return (double)stage.bytes; });
+		writeMetric(o, "stage_messages", "Messages a stage processed", [](Stage &stage) { return (double)stage.messages; });
+		writeMetric(o, "stage_allocations", "Allocations made during a stage", [](Stage &stage) { return (double)stage.allocations; });
+		writeMetric(o, "stage_allocated_bytes", "Bytes allocated during a stage", [](Stage &stage) { return (double)stage.allocated_bytes; });
+		writeMetric(o, "stage_peak_rss_bytes", "Process peak resident memory when a stage finished", [](Stage &stage) { return (double)stage.peak_rss_bytes; });
+
+		o << "# HELP " << METRIC_PREFIX << "peak_rss_bytes Process peak resident memory" << std::endl
+			<< "# TYPE " << METRIC_PREFIX << "peak_rss_bytes gauge" << std::endl
+			<< METRIC_PREFIX << "peak_rss_bytes " << peakResidentBytes() << std::endl;
+	}
+
+private:
+	struct Stage
+	{
+		std::string stage;
+		double wall_seconds;
+		double cpu_seconds;
+		std::uint64_t bytes;
+		std::uint64_t messages;
+		std::uint64_t allocations;
+		std::uint64_t allocated_bytes;
+		std::uint64_t peak_rss_bytes;
+	};
+
+	struct File
+	{
+		std::string filename;
+		std::vector<Stage> stages;
+	};
+
+	template <typename Value>
+	void writeMetric(std::ostream &o, const char *name, const char *help, Value value)
+	{
+		o << "# HELP " << METRIC_PREFIX << name << ' ' << help << std::endl
+			<< "# TYPE " << METRIC_PREFIX << name << " gauge" << std::endl;
+
+		for (auto &file : files)
+		{
+			for (auto &stage : file.stages)
+			{
+				o << METRIC_PREFIX << name << "{file=" << labelValue(file.filename) << ",stage=" << labelValue(stage.stage) << "} "
+					<< value(stage) << std::endl;
+			}
+		}
+	}
+
+	static const char *const METRIC_PREFIX;
+
+	std::vector<File> files;
+	std::vector<File>::size_type current_file = { 0 };
+
+	Stage current;
+	AllocationSnapshot current_allocations;
+	double current_cpu = { 0 };
+	boost::chrono::steady_clock::time_point current_start;
+};
+
+const char *const RunMetrics::METRIC_PREFIX = { "parse_comm_log_" };
+
+RunMetrics run_metrics;
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Allocations.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Spread a loop over a set of worker threads that are started once and kept waiting. The range is
+// cut into chunks that the workers (and the calling thread) take one at a time, so a chunk that is
+// slow to do doesn't hold the rest up. Each index is visited exactly once - results written in place
+// come out in the same order whatever thread did them
+
+class WorkerPool
+{
+public:
+	~WorkerPool()
+	{
+		stop();
+	}
+
+	// Purpose: Start the workers. threads includes the calling thread, so 1 means run everything inline
+	void start(std::size_t threads)
+	{
+		stop();
+
+		stopping = false;
+		for (std::size_t i = 1; i < threads; ++i)
+		{
+			workers.push_back(std::thread(&WorkerPool::work, this));
+		}
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	std::size_t threads() const { return workers.size() + 1; }
+
+	// Purpose: Call body(begin, end) over [0, count) and return once every chunk is done
+	void run(std::size_t count, const std::function<void(std::size_t, std::size_t)> &body)
+	{
+		std::size_t chunks = count / MIN_CHUNK_ITEMS;
+		if (chunks > threads() * CHUNKS_PER_THREAD)
+		{
+			chunks = threads() * CHUNKS_PER_THREAD;
+		}
+
+		if (workers.empty() || (chunks < 2))
+		{
+			body(0, count);
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		job = &body;
+		job_count = count;
+		job_chunks = chunks;
+		next_chunk = 0;
+		remaining = chunks;
+		wake.notify_all();
+
+		// Lend a hand rather than sit waiting
+		while (next_chunk < job_chunks)
+		{
+			doChunk(lock, false);
+		}
+		done.wait(lock, [this] { return remaining == 0; });
+
+		job = nullptr;
+		job_chunks = 0;
+		next_chunk = 0;
+	}
+
+private:
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			wake.wait(lock, [this] { return stopping || (next_chunk < job_chunks); });
+			if (stopping)
+			{
+				return;
+			}
+
+			doChunk(lock, true);
+		}
+	}
+
+	// Purpose: Claim the next chunk and do it with the lock released. A worker hands what it allocated
+	// over to the caller's stage before the chunk counts as done
+	void doChunk(std::unique_lock<std::mutex> &lock, bool worker)
+	{
+		std::size_t chunk = next_chunk++;
+		const std::function<void(std::size_t, std::size_t)> &body = *job;
+		std::size_t begin = (job_count * chunk) / job_chunks;
+		std::size_t end = (job_count * (chunk + 1)) / job_chunks;
+
+		// The job can't change until remaining reaches 0 - which needs this chunk
+		lock.unlock();
+		AllocationSnapshot before = AllocationSnapshot::onThisThread();
+		body(begin, end);
+		if (worker)
+		{
+			AllocationSnapshot::credit(AllocationSnapshot::onThisThread().since(before));
+		}
+		lock.lock();
+
+		if (--remaining == 0)
+		{
+			done.notify_all();
+		}
+	}
+
+	// Chunks smaller than this aren't worth handing to another thread
+	static const std::size_t MIN_CHUNK_ITEMS = { 256 };
+
+	// More chunks than threads so the load evens out
+	static const std::size_t CHUNKS_PER_THREAD = { 4 };
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping = { false };
+
+	// The loop being run - all guarded by mutex
+	const std::function<void(std::size_t, std::size_t)> *job = { nullptr };
+	std::size_t job_count = { 0 };
+	std::size_t job_chunks = { 0 };
+	std::size_t next_chunk = { 0 };
+	std::size_t remaining = { 0 };
+};
+
+WorkerPool parse_workers;
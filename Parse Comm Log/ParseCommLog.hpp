@@ -3,6 +3,7 @@
 #include <array>
 #include <boost/chrono.hpp>
 #include "ConsoleColor.h"
+#include <cstdint>
 #include <iomanip>  
 #include <iostream>
 #include <vector>
@@ -188,17 +189,70 @@ public:
 	unsigned char data;
 };
 
+// The type of request (from the system) a response (from the machine) is answering
+enum LastRequest
+{
+	UNKNOWN_REQUEST,
+	BP_REQUEST,
+	GP_REQUEST,
+	LP_REQUEST,
+};
+
+// Request offset of a message that isn't answering a request seen in the capture
+const std::uint64_t NO_REQUEST_OFFSET = { ~0ULL };
+
+// What a parsed message turned out to be. Nearly every message is one of a few hundred fixed
+// descriptions, so a message only keeps which one (and the byte it was picked by) - the text is put
+// together when the message is shown, and never for messages that aren't
+enum DescriptionType : unsigned char
+{
+	NOT_PARSED,
+	BROADCAST_POLL,      // BP[code]
+	GENERAL_POLL,        // GP[code]
+	LONG_POLL,           // long_poll[code]
+	UNKNOWN_POLL,        // ??[code]
+	MISSING_START,       // Request without its address byte
+	CHIRP,               // CHIRP[code]
+	BP_RESPONSE,         // Response to a broadcast poll
+	EXCEPTION,           // exceptions[code]
+	LONG_POLL_RESPONSE,  // long_poll[code]
+	UNKNOWN_RESPONSE,    // ??[code]
+	INVALID_DIRECTION,
+};
+
+struct Description
+{
+	Description() {}
+
+	Description(DescriptionType type, BYTE code)
+		:type(type),
+		code(code)
+	{
+	}
+
+	DescriptionType type = { NOT_PARSED };
+	BYTE code = { 0 };
+};
+
+std::ostream & operator << (std::ostream &o, const Description &description);
+
 bool START_OF_MESSAGE_DETECTED = { true };
 bool NO_START_OF_MESSAGE_DETECTED = { false };
 class Message
 {
 public:
-	void Message::startNew(Direction _direction, bool _start_of_message_detected)
+	void startNew(Direction _direction, bool _start_of_message_detected, std::uint64_t _offset)
 	{
 		direction = _direction;
 
+		offset = _offset;
+
 		start_of_message_detected = _start_of_message_detected;
 
+		request = UNKNOWN_REQUEST;
+		request_offset = NO_REQUEST_OFFSET;
+		description = Description();
+
 		raw_status_and_data_bytes.clear();
 	}
 
@@ -251,10 +305,25 @@ public:
 
 	Direction direction = { Direction::UNKNOWN };
 	bool start_of_message_detected = { false };
-	std::string description;
+	std::uint64_t offset = { 0 }; // Offset in the capture of the first status byte
+	LastRequest request = { UNKNOWN_REQUEST }; // Only meaningful for responses
+	std::uint64_t request_offset = { NO_REQUEST_OFFSET }; // Offset of the request a response answers
+	Description description;
 	std::vector<StatusAndData> raw_status_and_data_bytes;
 };
 
+// Purpose: FNV-1a hash of the status and data bytes of a message
+inline std::uint64_t hashMessage(Message &message)
+{
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (auto &status_and_data : message.raw_status_and_data_bytes)
+	{
+		hash = (hash ^ status_and_data.status.raw_status) * 1099511628211ULL;
+		hash = (hash ^ status_and_data.data) * 1099511628211ULL;
+	}
+	return hash;
+}
+
 unsigned char POLL_MASK = 0x80;
 
 std::array <std::string, 0x100> long_poll =
@@ -1082,18 +1151,61 @@ std::array <std::string, 0x100> exceptions =
 	"EXCEPTION FF - "
 };
 
-Message current_message;
-std::vector<Message> messages;
-std::vector<Message>::size_type messages_index = { 0 };
+// Purpose: Put together the text of a description. The stream's formatting is left as it was found
+inline std::ostream & operator << (std::ostream &o, const Description &description)
+{
+	std::ios_base::fmtflags flags = o.flags();
+	char fill = o.fill();
 
+	switch (description.type)
+	{
+	case NOT_PARSED:
+		break;
+
+	case BROADCAST_POLL:
+		o << "BP[" << std::nouppercase << std::hex << std::setfill('0') << std::setw(2) << (int)description.code << "]";
+		break;
+
+	case GENERAL_POLL:
+		o << "GP[" << std::nouppercase << std::hex << std::setfill('0') << std::setw(2) << (int)description.code << "]";
+		break;
+
+	case LONG_POLL:
+	case LONG_POLL_RESPONSE:
+		o << long_poll[description.code] << ':';
+		break;
+
+	case UNKNOWN_POLL:
+	case UNKNOWN_RESPONSE:
+		o << "??[" << std::nouppercase << std::hex << std::setfill('0') << std::setw(2) << (int)description.code << "]";
+		break;
+
+	case MISSING_START:
+		o << "Missing start of message :";
+		break;
+
+	case CHIRP:
+		o << "CHIRP[" << std::nouppercase << std::hex << std::setfill('0') << std::setw(2) << red << (int)description.code << "]";
+		break;
+
+	case BP_RESPONSE:
+		o << "BP[Shouldn't be a response - " << std::nouppercase << std::hex << std::setfill('0') << std::setw(2) << (int)description.code << "]";
+		break;
+
+	case EXCEPTION:
+		o << exceptions[description.code] << ':';
+		break;
+
+	case INVALID_DIRECTION:
+		o << " Invalid direction";
+		break;
+	}
 
-enum LastRequest
-{
-	UNKNOWN_REQUEST,
-	BP_REQUEST,
-	GP_REQUEST,
-	LP_REQUEST,
-};
+	o.flags(flags);
+	o.fill(fill);
+	return o;
+}
 
-LastRequest last_request = { UNKNOWN_REQUEST };
+std::vector<Message> messages;
+std::vector<Message>::size_type messages_index = { 0 };
 
@@ -0,0 +1,1521 @@
+// Parse Comm Log - Parse file generated by the AVP communications analyzer page dump
+//
+// Everything but the entry point - shared by the Windows console and POSIX front-ends. Most of the
+// headers below define global state, so apart from CommandLine.hpp only this file may include them
+
+#include "Archive.hpp"
+#include "Benchmark.hpp"
+#include "Checkpoint.hpp"
+#include "Collapse.hpp"
+#include "CommandLine.hpp"
+#include "Daemon.hpp"
+#include "Diff.hpp"
+#include "Filter.hpp"
+#include <fstream>
+#include "Framer.hpp"
+#include "Generator.hpp"
+#include "Index.hpp"
+#include "LineErrors.hpp"
+#include "Link.hpp"
+#include "Live.hpp"
+#include <locale>
+#include "Meters.hpp"
+#include "Metrics.hpp"
+#include <new>
+#include "Parallel.hpp"
+#include "ParseCommLog.hpp"
+#include "ParseCommLogCore.hpp"
+#include "Pipeline.hpp"
+#include "Prefetch.hpp"
+#include "Progress.hpp"
+#include "Sample.hpp"
+#include "Search.hpp"
+#include "Statistics.hpp"
+#include "Stitch.hpp"
+#include "Window.hpp"
+#include <ostream>
+#include <stdlib.h> 
+#include <string>
+
+//using namespace std;
+
+Options options;
+GeneratorMix generator_mix;
+
+// Search mode - where the patterns were found in the capture being framed, and the next one to report
+std::string search_filename;
+std::vector<PatternMatch> search_matches;
+std::vector<PatternMatch>::size_type search_matches_index = { 0 };
+
+// Checkpoint mode - the capture being framed, where framing picks up in it, and where the next
+// checkpoint is due
+const std::uint64_t NO_CHECKPOINT = { ~0ULL };
+std::size_t checkpoint_capture = { 0 };
+std::uint64_t resume_offset = { 0 };
+std::uint64_t next_checkpoint = { NO_CHECKPOINT };
+
+// Captures with an up to date index, by their place in options.filenames - only framed where the filter could match
+std::vector<bool> indexed_captures;
+
+void parseMessage(Message &message);
+
+// Purpose: True when messages are counted or analysed as they are framed, rather than listed
+bool countedAsFramed()
+{
+	return options.statistics || options.meters || link_analysis.active() || sampled_statistics.active();
+}
+
+// Purpose: True when captures with an index are only decoded where the filter could match - when
+// nothing but a filtered list of messages is wanted from them
+bool queriedByIndex()
+{
+	return !options.filter.empty() && !countedAsFramed() && options.search.empty() && !options.collapse && !options.error_window &&
+		!options.pipeline && !options.bench && !options.diff && options.window.empty() && options.checkpoint.empty() && !options.stitch &&
+		options.daemon.empty() && options.live.empty();
+}
+
+// Purpose: Report every search match that starts inside a framed message, along with the message
+void reportSearchMatches(Message &message)
+{
+	std::uint64_t end = message.offset + (message.raw_status_and_data_bytes.size() * 2);
+	bool parsed = false;
+
+	for (; search_matches_index != search_matches.size(); ++search_matches_index)
+	{
+		PatternMatch &match = search_matches[search_matches_index];
+		std::uint64_t match_offset = match.data_index * 2;
+		if (match_offset >= end)
+		{
+			break;
+		}
+		if (match_offset < message.offset)
+		{
+			continue; // In a message the filter dropped
+		}
+
+		if (!parsed)
+		{
+			parseMessage(message);
+			parsed = true;
+		}
+
+		std::vector<BYTE> &pattern = pattern_search.pattern(match.pattern);
+		std::cout << search_filename << " @" << std::dec << match_offset << " [";
+		for (auto data : pattern)
+		{
+			std::cout << std::setiosflags(std::ios::uppercase) << std::setfill('0') << std::setw(2) << std::hex << (int)data;
+		}
+		std::cout << "]" << ((match_offset + (pattern.size() * 2) > end) ? " (continues into the next message)" : "")
+			<< " in " << message << std::endl;
+	}
+}
+
+// Purpose: Called as each message is completely framed (and stamped with the request it answers).
+// Applies the filter so unwanted messages are dropped before they are saved
+void saveMessage(Message &message)
+{
+	frame_progress.countMessage();
+
+	if (message_filter.matches(message))
+	{
+		if (options.statistics)
+		{
+			message_statistics.add(message);
+		}
+		else if (options.meters)
+		{
+			meter_series.add(message);
+		}
+		else if (link_analysis.active())
+		{
+			link_analysis.add(message);
+		}
+		else if (sampled_statistics.active())
+		{
+			sampled_statistics.add(message);
+		}
+		else if (options.diff)
+		{
+			capture_diff.add(message);
+		}
+		else if (pattern_search.active())
+		{
+			reportSearchMatches(message);
+		}
+		else if (repeat_collapser.active())
+		{
+			repeat_collapser.add(message);
+		}
+		else if (message_pipeline.active())
+		{
+			message_pipeline.framed(message);
+		}
+		else
+		{
+			messages.push_back(message);
+		}
+	}
+}
+
+// Purpose: Parse a request (from the system)
+void parseRequest(Message &message)
+{
+	// If SAS
+	StatusAndData &first = message.raw_status_and_data_bytes[0];
+
+	if (first.addressByte())
+	{
+		if (first.broadcastPoll())
+		{
+			message.description = Description(BROADCAST_POLL, first.data);
+		}
+		else if (first.generalPoll())
+		{
+			message.description = Description(GENERAL_POLL, first.data);
+		}
+		else if (first.longPoll())
+		{
+			message.description = Description(LONG_POLL, first.data);
+		}
+		else
+		{
+			message.description = Description(UNKNOWN_POLL, first.data);
+		}
+	}
+	else
+	{
+		message.description = Description(MISSING_START, first.data);
+	}
+}
+
+
+void parseComment(Message &message)
+{/*
+	std::ostringstream ss; // (message.description);
+	ss << (unsigned char) message.raw_status_and_data_bytes[0].data;
+	message.description = ss.str();
+	*/
+}
+
+// Purpose: Parse a response (from the machine)
+void parseResponse(Message &message)
+{
+	// If SAS
+	StatusAndData &first = message.raw_status_and_data_bytes[0];
+
+	if (first.addressByte())
+	{
+		message.description = Description(CHIRP, first.data);
+	}
+	else
+	{
+		switch (message.request)
+		{
+		case BP_REQUEST:
+			message.description = Description(BP_RESPONSE, first.data);
+			break;
+
+		case GP_REQUEST:
+			message.description = Description(EXCEPTION, first.data);
+			break;
+
+		case LP_REQUEST:
+			message.description = Description(LONG_POLL_RESPONSE, first.data);
+			break;
+
+		default:
+			message.description = Description(UNKNOWN_RESPONSE, first.data);
+			break;
+		}
+	}
+}
+
+// Purpose: Parse an individual message and add the 
+void parseMessage(Message &message)
+{
+	switch (message.getDirection())
+	{
+	case Direction::RX:
+		parseRequest(message);
+		break;
+
+	case Direction::TX:
+		parseResponse(message);
+		break;
+
+	case Direction::COMMENT:
+		parseComment(message);
+		break;
+
+	default:
+		message.description = Description(INVALID_DIRECTION, 0);
+		break;
+	}
+}
+
+// Purpose: Parse a batch of messages across the parse workers. Nothing a message is parsed with comes
+// from another message, so they can be done in any order - each is parsed in place, keeping its position
+void parseMessages(std::vector<Message> &batch)
+{
+	parse_workers.run(batch.size(), [&batch](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i != end; ++i)
+		{
+			parseMessage(batch[i]);
+		}
+	});
+}
+
+struct space_out : std::numpunct < char >
+{
+	char do_thousands_sep()   const { return ' '; } // separate with spaces
+	std::string do_grouping() const { return "\1"; } // groups of 1 digit
+};
+
+struct g3 : std::numpunct < char >
+{
+	std::string do_grouping() const { return "\3"; }
+};
+
+// Purpose: Read the stream of bytes from a capture file into a vector, without reporting anything. The
+// file is sized first and read straight into the vector in one go. Called on the prefetch threads
+std::vector<BYTE> loadCapture(const std::string &filename)
+{
+	std::ifstream myfile(filename, std::ios::in | std::ios::binary);
+	if (!myfile.is_open())
+	{
+		throw std::runtime_error("File could not be opened");
+	}
+
+	myfile.seekg(0, std::ios::end);
+	std::fstream::pos_type size = myfile.tellg();
+	myfile.seekg(0, std::ios::beg);
+
+#ifdef __VERBOSE_FILE_INFORMATION__
+	std::cout << filename.c_str() << " open : size=" << size << " bytes" << std::endl;
+#endif // __VERBOSE_FILE_INFORMATION__
+
+	std::vector<BYTE> bytes((std::vector<BYTE>::size_type)size);
+	if (!bytes.empty() && !myfile.read((char *)bytes.data(), bytes.size()))
+	{
+		throw std::runtime_error("File could not be read");
+	}
+	myfile.close();
+	return bytes;
+}
+
+// Purpose: Get the stream of bytes from a capture file - most likely already read ahead by the prefetcher
+std::vector<BYTE> readCapture(const std::string &filename)
+{
+	std::cout << "Open " << filename << std::endl;
+	boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+	std::vector<BYTE> bytes = capture_prefetcher.next(filename);
+	boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+
+	// The read itself may have been done ahead, on another thread - its rate is that read's, not the wait's
+	double read_seconds = capture_prefetcher.readSeconds();
+	std::cout << "took " << read_seconds << " seconds to read " << bytes.size() << " bytes ("
+		<< ((read_seconds > 0) ? (bytes.size() / read_seconds) : 0) << " BPS), waited " << sec.count() << " seconds for it" << std::endl;
+
+	return bytes;
+}
+
+// Purpose: Assemble the stream of status/data bytes into messages. Progress is only shown on request -
+// nothing else may write to the console while messages are being shown as they are framed, or while
+// the pipeline is running
+void frameCapture(std::vector<BYTE> &bytes, bool show_progress = true, std::uint64_t base_offset = 0)
+{
+	frame_progress.reset();
+	if (show_progress)
+	{
+		std::cout << bytes.size() << " bytes to scan" << std::endl;
+		frame_progress.start(bytes.size());
+	}
+
+	std::vector<unsigned char>::size_type from = 0;
+	if (resume_offset)
+	{
+		// Carrying on from a checkpoint - the framer is already as it was there
+		from = (std::vector<unsigned char>::size_type)resume_offset;
+		resume_offset = 0;
+	}
+	else
+	{
+		message_framer.startOfStream();
+	}
+
+	std::vector<unsigned char>::size_type size = ((bytes.size() / 2) * 2); // Force to multiple of two so they always come in status:data pairs
+	for (std::vector<unsigned char>::size_type i = from; i != size;)
+	{
+		if (i == next_checkpoint)
+		{
+			batch_checkpoint.write(checkpoint_capture, options.filenames[checkpoint_capture], i);
+			next_checkpoint += BatchCheckpoint::INTERVAL_BYTES;
+		}
+
+		frame_progress.setBytes(i);
+
+		// Read next status/data bytes from stream of bytes
+		std::uint64_t offset = base_offset + i;
+		unsigned char status = (unsigned char)bytes[i++];
+		unsigned char data = (unsigned char)bytes[i++];
+		StatusAndData status_and_data(status, data);
+
+		// Assemble into messages
+		message_framer.searchForMessage(status_and_data, offset);
+	}
+
+	if (batch_checkpoint.active())
+	{
+		// Before the message in progress is ended - the capture may yet be appended to
+		batch_checkpoint.take(checkpoint_capture, options.filenames[checkpoint_capture], size);
+	}
+	message_framer.endOfStream();
+
+	frame_progress.stop();
+}
+
+// Purpose: Frame a compact archive straight from its status and data streams, a block at a time -
+// the status/data pairs are never put back together. Offsets are still offsets in the capture
+void frameArchive(const std::vector<BYTE> &bytes, bool show_progress = true)
+{
+	CompactArchive archive(bytes);
+
+	frame_progress.reset();
+	if (show_progress)
+	{
+		std::cout << (archive.pairs() * 2) << " bytes to scan" << std::endl;
+		frame_progress.start(archive.pairs() * 2);
+	}
+
+	std::vector<BYTE> status;
+	std::vector<BYTE> data;
+
+	message_framer.startOfStream();
+	for (std::size_t block = 0; block != archive.blocks(); ++block)
+	{
+		std::size_t pairs = archive.unpackBlock(block, status, data);
+		std::uint64_t offset = archive.firstPair(block) * 2;
+		for (std::size_t i = 0; i != pairs; ++i, offset += 2)
+		{
+			frame_progress.setBytes(offset);
+			message_framer.searchForMessage(StatusAndData(status[i], data[i]), offset);
+		}
+	}
+	message_framer.endOfStream();
+
+	frame_progress.stop();
+}
+
+// Purpose: Frame the next segment of a rotated capture. The framer carries on from the segment before
+// (it is started and ended for the whole stream by the caller) and offsets carry on from base_offset,
+// so a message cut by the rotation comes out whole
+void frameSegment(std::vector<BYTE> &bytes, std::uint64_t base_offset)
+{
+	frame_progress.reset();
+	std::cout << bytes.size() << " bytes to scan" << std::endl;
+	frame_progress.start(bytes.size());
+
+	for (std::vector<BYTE>::size_type i = 0, size = ((bytes.size() / 2) * 2); i != size; i += 2)
+	{
+		frame_progress.setBytes(i);
+		message_framer.searchForMessage(StatusAndData(bytes[i], bytes[i + 1]), base_offset + i);
+	}
+
+	frame_progress.stop();
+}
+
+// Purpose: Frame a capture or a compact archive of one
+void frameAny(std::vector<BYTE> &bytes, bool show_progress = true)
+{
+	if (isCompactArchive(bytes))
+	{
+		frameArchive(bytes, show_progress);
+	}
+	else
+	{
+		frameCapture(bytes, show_progress);
+	}
+}
+
+// Purpose: Read, frame, parse and show only the window of a capture asked for. Framing starts a little
+// before the window, from the request the first messages may be answering - anything framed before
+// the window is dropped
+void decodeWindow(const std::string &filename)
+{
+	std::cout << "Open " << filename << std::endl;
+	boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+
+	run_metrics.start("locate");
+	WindowRange range = capture_window.locate(filename);
+	std::vector<BYTE> bytes = capture_window.read(range.frame_from, range.end);
+	run_metrics.stop(bytes.size(), 0);
+
+	run_metrics.start("frame");
+	frameCapture(bytes, false, range.frame_from);
+	std::vector<Message>::iterator in_window = messages.begin();
+	while ((in_window != messages.end()) && (in_window->offset < range.begin))
+	{
+		++in_window;
+	}
+	messages.erase(messages.begin(), in_window);
+	run_metrics.stop(bytes.size(), frame_progress.framedMessages());
+
+	run_metrics.start("parse");
+	parseMessages(messages);
+	run_metrics.stop(0, messages.size());
+
+	boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+	std::cout << "took " << sec.count() << " seconds to decode @" << std::dec << range.begin << " to @" << range.end
+		<< " (framed from @" << range.frame_from << ")" << std::endl;
+
+	run_metrics.start("display");
+	for (auto &message : messages)
+	{
+		std::cout << '@' << std::dec << message.offset << ' ' << message << std::endl;
+	}
+	run_metrics.stop(0, messages.size());
+	std::cout << std::dec << messages.size() << " messages in the window" << std::endl;
+	messages.clear();
+}
+
+// Purpose: Read the index of a capture into capture_index. False if it has none, or the capture has
+// changed since it was indexed. Throws std::runtime_error if the index can't be read
+bool readCaptureIndex(const std::string &filename, bool &archive)
+{
+	std::ifstream capture(filename, std::ios::in | std::ios::binary);
+	if (!capture.is_open())
+	{
+		return false;
+	}
+
+	char magic[sizeof(COMPACT_MAGIC)];
+	archive = capture.read(magic, sizeof(magic)) && (std::memcmp(magic, COMPACT_MAGIC, sizeof(magic)) == 0);
+
+	capture.clear();
+	capture.seekg(0, std::ios::end);
+	return capture_index.read(filename + ".pci", (std::uint64_t)capture.tellg());
+}
+
+// Purpose: Frame only the chunks of an indexed capture the filter could match. Each run of them is
+// found and framed as a window is - from the request the first message may be answering - keeping
+// just the messages that start in the run. A compact archive can't be read in part, so is framed
+// whole if any of it could match. Nothing is read at all if none of it could
+void decodeIndexed(const std::string &filename)
+{
+	std::cout << "Open " << filename << std::endl;
+	boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+
+	bool archive = false;
+	if (!readCaptureIndex(filename, archive))
+	{
+		throw std::runtime_error("Capture has changed since it was indexed");
+	}
+
+	std::size_t matching = capture_index.matchingChunks(message_filter);
+	std::uint64_t framed = 0;
+	if (!matching)
+	{
+		// Nothing to do
+	}
+	else if (archive)
+	{
+		run_metrics.start("read");
+		std::vector<BYTE> bytes = loadCapture(filename);
+		run_metrics.stop(bytes.size(), 0);
+
+		run_metrics.start("frame");
+		frameArchive(bytes, false);
+		run_metrics.stop(bytes.size(), frame_progress.framedMessages());
+		framed = bytes.size();
+	}
+	else
+	{
+		CaptureWindow run_window;
+		std::ifstream capture(filename, std::ios::in | std::ios::binary | std::ios::ate);
+		std::uint64_t capture_bytes = ((std::uint64_t)capture.tellg() / 2) * 2;
+		capture.close();
+
+		for (auto &run : capture_index.matchingRanges(message_filter, capture_bytes))
+		{
+			run_metrics.start("locate");
+			run_window.setBytes(run.first, run.second);
+			WindowRange range = run_window.locate(filename);
+			std::vector<BYTE> bytes = run_window.read(range.frame_from, range.end);
+			run_metrics.stop(bytes.size(), 0);
+
+			run_metrics.start("frame");
+			std::size_t kept = messages.size();
+			frameCapture(bytes, false, range.frame_from);
+			std::vector<Message>::iterator in_run = messages.begin() + kept;
+			while ((in_run != messages.end()) && (in_run->offset < run.first))
+			{
+				++in_run;
+			}
+			messages.erase(messages.begin() + kept, in_run);
+			run_metrics.stop(bytes.size(), frame_progress.framedMessages());
+			framed += bytes.size();
+		}
+	}
+
+	boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+	std::cout << std::dec << "took " << sec.count() << " seconds to decode " << matching << " of " << capture_index.chunkCount()
+		<< " indexed chunks (" << framed << " bytes)" << std::endl;
+}
+
+// Purpose: Parse and show the messages framed so far
+void showMessages()
+{
+	std::cout << messages.size() << " messages to parse" << std::endl;
+	run_metrics.start("parse");
+	parseMessages(messages);
+	run_metrics.stop(0, messages.size());
+
+	// Display list of messages pulled from byte stream
+	std::cout << "Display " << messages.size() << " parsed messages" << std::endl;
+	run_metrics.start("display");
+	for (auto iter : messages)
+	{
+		std::cout << iter << std::endl;
+	}
+	std::cout << std::dec << std::nouppercase; // Messages leave the console in hex - counts that follow are decimal
+	run_metrics.stop(0, messages.size());
+	messages.clear();
+}
+
+// Purpose: Write the checkpoint taken at the end of a capture, once everything framed before it has been output
+void commitCheckpoint(const std::string &filename)
+{
+	try
+	{
+		batch_checkpoint.commit();
+	}
+	catch (std::exception const& e)
+	{
+		std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+	}
+}
+
+// Purpose: Parse and show a message as soon as it is framed
+void displayMessage(Message &message)
+{
+	parseMessage(message);
+	std::cout << message << std::endl;
+}
+
+// Purpose: Show one copy of a repeating sequence of messages and how often it repeated
+void displayRun(std::vector<Message> &cycle, std::uint64_t repeats, std::uint64_t start, std::uint64_t end)
+{
+	for (auto &message : cycle)
+	{
+		displayMessage(message);
+	}
+	std::cout << "... last " << std::dec << cycle.size() << " message(s) repeated " << repeats << " times (@" << start << " to @" << end << ")" << std::endl;
+}
+
+// Purpose: Rebuild a framed message from its record and the capture it was framed from
+Message rebuildMessage(MessageRecord &record, std::vector<BYTE> &bytes)
+{
+	Message message;
+	message.startNew(record.direction, NO_START_OF_MESSAGE_DETECTED, record.offset);
+	message.request = record.request;
+	for (std::uint64_t i = record.offset; i != record.offset + (record.length * 2); i += 2)
+	{
+		message.raw_status_and_data_bytes.push_back(StatusAndData(bytes[(std::size_t)i], bytes[(std::size_t)i + 1]));
+	}
+	parseMessage(message);
+	return message;
+}
+
+// Purpose: Frame two captures and show only the messages that were deleted, inserted or changed
+int diffCaptures()
+{
+	std::vector<BYTE> bytes[2];
+
+	for (int capture = 0; capture != 2; ++capture)
+	{
+		try
+		{
+			run_metrics.startFile(options.filenames[capture]);
+			run_metrics.start("read");
+			bytes[capture] = readCapture(options.filenames[capture]);
+			if (isCompactArchive(bytes[capture]))
+			{
+				// Changed messages are rebuilt from the pairs
+				bytes[capture] = expandArchive(bytes[capture]);
+			}
+			run_metrics.stop(bytes[capture].size(), 0);
+
+			run_metrics.start("frame");
+			capture_diff.selectCapture(capture);
+			frameCapture(bytes[capture]);
+			run_metrics.stop(bytes[capture].size(), frame_progress.framedMessages());
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while processing '" << options.filenames[capture] << "' : " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	run_metrics.startFile("");
+	run_metrics.start("compare");
+	boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+	std::vector<DiffEdit> edits = capture_diff.compare();
+	boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+	run_metrics.stop(0, edits.size());
+	std::cout << "took " << sec.count() << " seconds to compare" << std::endl;
+
+	std::cout << "--- " << options.filenames[0] << std::endl
+		<< "+++ " << options.filenames[1] << std::endl;
+	for (auto &edit : edits)
+	{
+		switch (edit.type)
+		{
+		case DiffType::DELETED:
+		{
+			Message message = rebuildMessage(capture_diff.record(0, edit.a_index), bytes[0]);
+			std::cout << "- a@" << std::dec << message.offset << ' ' << message << std::endl;
+		}
+		break;
+
+		case DiffType::INSERTED:
+		{
+			Message message = rebuildMessage(capture_diff.record(1, edit.b_index), bytes[1]);
+			std::cout << "+ b@" << std::dec << message.offset << ' ' << message << std::endl;
+		}
+		break;
+
+		case DiffType::CHANGED:
+		{
+			Message before = rebuildMessage(capture_diff.record(0, edit.a_index), bytes[0]);
+			Message after = rebuildMessage(capture_diff.record(1, edit.b_index), bytes[1]);
+			std::cout << "! a@" << std::dec << before.offset << ' ' << before << std::endl;
+			std::cout << "! b@" << std::dec << after.offset << ' ' << after << std::endl;
+		}
+		break;
+		}
+	}
+	std::cout << std::dec << edits.size() << " differences" << std::endl;
+
+	return 0;
+}
+
+// Purpose: Write the stage metrics of the run to the files asked for ("-" is the console)
+void writeMetrics()
+{
+	const std::string *paths[] = { &options.metrics, &options.prometheus };
+	for (int format = 0; format != 2; ++format)
+	{
+		const std::string &path = *paths[format];
+		if (path.empty())
+		{
+			continue;
+		}
+
+		std::ofstream file;
+		if (path != "-")
+		{
+			file.open(path, std::ios::out | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cout << "Error while writing metrics to '" << path << "' : File could not be opened" << std::endl;
+				continue;
+			}
+		}
+
+		std::ostream &o = (path == "-") ? std::cout : file;
+		if (format == 0)
+		{
+			run_metrics.writeJson(o);
+		}
+		else
+		{
+			run_metrics.writePrometheus(o);
+		}
+	}
+}
+
+// Purpose: Report the meters, and write their series if asked to
+void reportMeters()
+{
+	meter_series.report(std::cout);
+
+	if (!options.series.empty())
+	{
+		std::ofstream series(options.series, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (series.is_open())
+		{
+			meter_series.writeSeries(series);
+		}
+		if (!series.is_open() || !series.flush())
+		{
+			std::cout << "Error while writing '" << options.series << "' : File could not be written" << std::endl;
+		}
+	}
+}
+
+// Purpose: Frame each machine and port's rotated captures as one stream. The messages are shown after
+// each segment - all but one still being framed, which comes out with the next segment
+int stitchCaptures()
+{
+	for (auto &stream : stitchSegments(options.filenames))
+	{
+		if (stream.front().rotated)
+		{
+			std::cout << "Stitching " << stream.front().machine << " SAS" << stream.front().port << " from " << stream.size() << " segment(s)" << std::endl;
+		}
+
+		message_framer.startOfStream();
+		std::uint64_t base_offset = 0;
+		std::vector<BYTE> carried; // A status byte cut from its data byte by the rotation
+
+		for (auto &segment : stream)
+		{
+			run_metrics.startFile(segment.filename);
+
+			try
+			{
+				run_metrics.start("read");
+				std::vector<BYTE> bytes = readCapture(segment.filename);
+				run_metrics.stop(bytes.size(), 0);
+
+				if (isCompactArchive(bytes))
+				{
+					bytes = expandArchive(bytes);
+				}
+				if (!carried.empty())
+				{
+					bytes.insert(bytes.begin(), carried.begin(), carried.end());
+					carried.clear();
+				}
+
+				run_metrics.start("frame");
+				frameSegment(bytes, base_offset);
+				run_metrics.stop(bytes.size(), frame_progress.framedMessages());
+
+				std::vector<BYTE>::size_type size = ((bytes.size() / 2) * 2);
+				carried.assign(bytes.begin() + size, bytes.end());
+				base_offset += size;
+			}
+			catch (std::exception const& e)
+			{
+				// The stream has a hole in it - nothing after it can be stitched to anything before
+				std::cout << "Error while processing '" << segment.filename << "' : " << e.what() << std::endl;
+				message_framer.endOfStream();
+				message_framer.startOfStream();
+				carried.clear();
+			}
+
+			if (!countedAsFramed())
+			{
+				showMessages();
+			}
+		}
+
+		message_framer.endOfStream();
+		if (!countedAsFramed() && !messages.empty())
+		{
+			showMessages();
+		}
+	}
+
+	if (options.statistics)
+	{
+		message_statistics.report(std::cout);
+	}
+	if (options.meters)
+	{
+		reportMeters();
+	}
+	if (link_analysis.active())
+	{
+		link_analysis.report(std::cout);
+	}
+
+	writeMetrics();
+	return 0;
+}
+
+// Purpose: Write a synthetic capture of the requested size and mix
+int generateCapture()
+{
+	std::ofstream capture(options.generate, std::ios::out | std::ios::binary);
+	if (!capture.is_open())
+	{
+		std::cout << "Error while processing '" << options.generate << "' : File could not be opened" << std::endl;
+		return 1;
+	}
+
+	CaptureGenerator generator(generator_mix);
+	generator.write(capture, (std::uint64_t)options.size * 1024 * 1024);
+	std::cout << "Wrote " << capture.tellp() << " bytes to " << options.generate << std::endl;
+
+	return 0;
+}
+
+// Purpose: Write each capture as a compact archive alongside it
+int archiveCaptures()
+{
+	for (auto &filename : options.filenames)
+	{
+		try
+		{
+			std::vector<BYTE> bytes = readCapture(filename);
+			if (isCompactArchive(bytes))
+			{
+				throw std::runtime_error("Already a compact archive");
+			}
+
+			std::string archive_filename = filename + ".pcz";
+			std::ofstream archive(archive_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!archive.is_open())
+			{
+				throw std::runtime_error("'" + archive_filename + "' could not be opened");
+			}
+
+			boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+			writeCompactArchive(archive, bytes);
+			boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+
+			std::uint64_t archive_size = archive.tellp();
+			std::cout << std::dec << "Wrote " << archive_size << " bytes to " << archive_filename << " ("
+				<< (archive_size ? ((double)bytes.size() / archive_size) : 0) << " times smaller) in " << sec.count() << " seconds" << std::endl;
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+		}
+	}
+
+	return 0;
+}
+
+// Purpose: Write an index of each capture alongside it
+int indexCaptures()
+{
+	message_framer.saved = [](Message &message) { capture_index.add(message); };
+
+	for (auto &filename : options.filenames)
+	{
+		try
+		{
+			std::vector<BYTE> bytes = readCapture(filename);
+
+			boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+			capture_index.start();
+			frameAny(bytes, false);
+
+			std::string index_filename = filename + ".pci";
+			std::ofstream index(index_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!index.is_open())
+			{
+				throw std::runtime_error("'" + index_filename + "' could not be opened");
+			}
+			capture_index.write(index, bytes.size(), isCompactArchive(bytes) ? (CompactArchive(bytes).pairs() * 2) : bytes.size());
+			boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+
+			std::cout << std::dec << "Wrote " << (std::uint64_t)index.tellp() << " bytes to " << index_filename << " (" << capture_index.chunkCount()
+				<< " chunks) in " << sec.count() << " seconds" << std::endl;
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+		}
+	}
+
+	return 0;
+}
+
+// Purpose: Estimate the statistics of the captures by framing a random sample of chunks of each
+int sampleCaptures()
+{
+	SampleSource source;
+	for (auto &filename : options.filenames)
+	{
+		run_metrics.startFile(filename);
+		try
+		{
+			std::cout << "Open " << filename << std::endl;
+			boost::chrono::system_clock::time_point start = boost::chrono::system_clock::now();
+			source.open(filename);
+
+			std::uint64_t framed = 0;
+			std::uint64_t chunk_bytes = sampled_statistics.chunkBytes();
+			std::vector<std::uint64_t> chunks = sampled_statistics.pickChunks(source.size());
+			run_metrics.start("sample");
+			for (auto chunk : chunks)
+			{
+				std::uint64_t from = chunk * chunk_bytes;
+				std::uint64_t to = ((source.size() - from) > chunk_bytes) ? (from + chunk_bytes) : source.size();
+				std::uint64_t frame_from = 0;
+				std::vector<BYTE> bytes = source.readResynced(from, to, frame_from);
+
+				sampled_statistics.startChunk(from, to);
+				frameCapture(bytes, false, frame_from);
+				sampled_statistics.endChunk(to - from);
+				framed += bytes.size();
+			}
+			sampled_statistics.endCapture(source.size());
+			run_metrics.stop(framed, frame_progress.framedMessages());
+
+			boost::chrono::duration<double> sec = boost::chrono::system_clock::now() - start;
+			std::cout << std::dec << "took " << sec.count() << " seconds to sample " << chunks.size() << " chunks (" << framed << " of " << source.size() << " bytes)" << std::endl;
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+		}
+	}
+
+	sampled_statistics.report(std::cout, source.fileBytesRead());
+	writeMetrics();
+	return 0;
+}
+
+// Purpose: Time reading, framing, parsing and formatting each capture as separate passes
+int benchmarkCaptures()
+{
+	for (auto &filename : options.filenames)
+	{
+		Benchmark benchmark;
+		std::vector<BYTE> bytes;
+
+		try
+		{
+			benchmark.start();
+			bytes = loadCapture(filename);
+			benchmark.stop("read", bytes.size(), 0);
+
+			// Rates are of the capture - an archive of it is smaller
+			std::uint64_t capture_bytes = isCompactArchive(bytes) ? (CompactArchive(bytes).pairs() * 2) : bytes.size();
+
+			benchmark.start();
+			frameAny(bytes, false);
+			benchmark.stop("frame", capture_bytes, messages.size());
+
+			benchmark.start();
+			parseMessages(messages);
+			benchmark.stop("parse", capture_bytes, messages.size());
+
+			// Formatted text is thrown away every so often so the benchmark doesn't measure a huge string growing
+			std::ostringstream formatted;
+			std::uint64_t formatted_bytes = 0;
+			benchmark.start();
+			for (std::vector<Message>::size_type i = 0; i != messages.size(); ++i)
+			{
+				formatted << messages[i] << '\n';
+				if (!((i + 1) % 1024) || ((i + 1) == messages.size()))
+				{
+					formatted_bytes += formatted.tellp();
+					formatted.str("");
+				}
+			}
+			benchmark.stop("format", formatted_bytes, messages.size());
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+			messages.clear();
+			continue;
+		}
+
+		std::cout << std::dec << "Benchmark " << filename << " : " << bytes.size() << " bytes, " << messages.size() << " messages" << std::endl;
+		benchmark.report(std::cout);
+		messages.clear();
+	}
+
+	return 0;
+}
+
+#ifndef _WIN32
+// Purpose: Run as a daemon until killed, decoding the captures clients send over the socket
+int serveDecodeRequests()
+{
+	decode_daemon.load = loadCapture;
+	decode_daemon.parse = parseMessage;
+
+	try
+	{
+		decode_daemon.serve(options.daemon, options.threads);
+	}
+	catch (std::exception const& e)
+	{
+		std::cout << "Error while serving on '" << options.daemon << "' : " << e.what() << std::endl;
+	}
+	return 1;
+}
+#endif
+
+#ifndef _WIN32
+// Purpose: Show the messages from the capture device as they arrive, until it closes or Ctrl+C
+int decodeLive()
+{
+	live_capture.show = [](Message &message)
+	{
+		if (!message_filter.matches(message))
+		{
+			return false;
+		}
+
+		if (options.meters)
+		{
+			// Only the changes are shown
+			return meter_series.add(message) != 0;
+		}
+
+		parseMessage(message);
+		std::cout << message << std::endl;
+		return true;
+	};
+	meter_series.changed = [](const MeterChange &change)
+	{
+		MeterSeries::describe(std::cout, change);
+		std::cout << std::endl;
+	};
+
+	run_metrics.startFile(options.live);
+	try
+	{
+		live_capture.open(options.live, options.gap);
+		std::cout << "Reading " << options.live << " live" << std::endl;
+
+		run_metrics.start("live");
+		std::uint64_t bytes = live_capture.run();
+		run_metrics.stop(bytes, live_capture.messagesShown());
+	}
+	catch (std::exception const& e)
+	{
+		std::cout << "Error while reading '" << options.live << "' : " << e.what() << std::endl;
+		return 1;
+	}
+
+	live_capture.report(std::cout);
+	if (options.meters)
+	{
+		meter_series.report(std::cout);
+	}
+	writeMetrics();
+	return 0;
+}
+#endif
+
+// Purpose: Frame and parse a capture into a table, with a framer and filters of its own
+void decodeTable(std::vector<BYTE> &bytes, const std::string &filter, MessageTable &table)
+{
+	MessageFilter wanted;
+	wanted.set(filter);
+	MessageFilter fields_filter; // Only for its fields, which it must work out for every message
+
+	if (isCompactArchive(bytes))
+	{
+		bytes = expandArchive(bytes);
+	}
+
+	table.rows.clear();
+	table.payload.clear();
+
+	MessageFramer framer;
+	framer.saved = [&](Message &message)
+	{
+		FilterFields fields = fields_filter.extractFields(message);
+		if (!wanted.matches(message))
+		{
+			return;
+		}
+
+		parseMessage(message);
+
+		MessageRow row = {};
+		row.offset = message.offset;
+		row.payload = table.payload.size();
+		row.length = (std::uint32_t)message.raw_status_and_data_bytes.size();
+		row.direction = (std::uint8_t)message.direction;
+		row.type = (std::uint8_t)message.description.type;
+		row.code = message.description.code;
+		row.address = fields.address;
+		row.long_poll = fields.long_poll;
+		row.errors = fields.errors;
+		row.known = (fields.address_valid ? ROW_ADDRESS_KNOWN : 0) | (fields.long_poll_valid ? ROW_LONG_POLL_KNOWN : 0);
+		row.request = (std::uint8_t)message.request;
+		table.rows.push_back(row);
+
+		for (auto &status_and_data : message.raw_status_and_data_bytes)
+		{
+			table.payload.push_back(status_and_data.data);
+		}
+	};
+
+	framer.startOfStream();
+	for (std::size_t i = 0, size = ((bytes.size() / 2) * 2); i != size; i += 2)
+	{
+		framer.searchForMessage(StatusAndData(bytes[i], bytes[i + 1]), i);
+	}
+	framer.endOfStream();
+}
+
+// Purpose: Name the values of the row fields, for front-ends that can't include the headers
+std::vector<std::pair<std::string, int>> messageTableNames()
+{
+	return {
+		{ "UNKNOWN", UNKNOWN }, { "RX", RX }, { "TX", TX }, { "COMMENT", COMMENT },
+		{ "NOT_PARSED", NOT_PARSED }, { "BROADCAST_POLL", BROADCAST_POLL }, { "GENERAL_POLL", GENERAL_POLL },
+		{ "LONG_POLL", LONG_POLL }, { "UNKNOWN_POLL", UNKNOWN_POLL }, { "MISSING_START", MISSING_START },
+		{ "CHIRP", CHIRP }, { "BP_RESPONSE", BP_RESPONSE }, { "EXCEPTION", EXCEPTION },
+		{ "LONG_POLL_RESPONSE", LONG_POLL_RESPONSE }, { "UNKNOWN_RESPONSE", UNKNOWN_RESPONSE },
+		{ "INVALID_DIRECTION", INVALID_DIRECTION },
+		{ "UNKNOWN_REQUEST", UNKNOWN_REQUEST }, { "BP_REQUEST", BP_REQUEST }, { "GP_REQUEST", GP_REQUEST },
+		{ "LP_REQUEST", LP_REQUEST },
+		{ "OVERRUN_ERROR_FLAG", OVERRUN_ERROR_FLAG }, { "FRAMING_ERROR_FLAG", FRAMING_ERROR_FLAG },
+		{ "BREAK_ERROR_FLAG", BREAK_ERROR_FLAG },
+		{ "ROW_ADDRESS_KNOWN", ROW_ADDRESS_KNOWN }, { "ROW_LONG_POLL_KNOWN", ROW_LONG_POLL_KNOWN },
+	};
+}
+
+void countAllocationsWith(void (*counts)(std::uint64_t &count, std::uint64_t &bytes))
+{
+	allocation_counts = counts;
+}
+
+int runParseCommLog(const std::vector<std::string> &arguments)
+{
+	//std::locale loc(std::cout.getloc());
+	//std::cout.imbue(std::locale(std::cout.getloc(), new g3)); // Setup 3 digit grouping (i.e. thousands separator)
+
+	try
+	{
+		options = parseCommandLine(arguments);
+		message_framer.saved = saveMessage;
+		message_filter.set(options.filter);
+		pattern_search.set(options.search);
+
+		if (options.collapse)
+		{
+			repeat_collapser.setMaximumPeriod(options.collapse);
+			repeat_collapser.emit_message = displayMessage;
+			repeat_collapser.emit_run = displayRun;
+		}
+
+		if (options.error_window)
+		{
+			line_error_analysis.set(options.error_window, options.burst);
+		}
+
+		if (options.pipeline)
+		{
+			message_pipeline.enable();
+		}
+
+		generator_mix = parseMix(options.mix);
+		if (!options.link.empty())
+		{
+			link_analysis.set(parseLinkSettings(options.link));
+		}
+		if (!options.sample.empty())
+		{
+			sampled_statistics.set(parseSampleSettings(options.sample));
+		}
+		capture_window.set(options.window);
+
+		// The daemon's threads serve a request each rather than sharing out the parsing of one
+		parse_workers.start(options.daemon.empty() ? options.threads : 1);
+
+		if (!options.checkpoint.empty())
+		{
+			batch_checkpoint.set(options.checkpoint, (options.statistics ? "stats " : (options.meters ? "meters " : "list ")) + options.filter);
+			batch_checkpoint.save_state = [](std::ostream &o)
+			{
+				message_framer.save(o);
+				message_filter.save(o);
+				message_statistics.save(o);
+				meter_series.save(o);
+			};
+			batch_checkpoint.restore_state = [](std::istream &i)
+			{
+				message_framer.restore(i);
+				message_filter.restore(i);
+				message_statistics.restore(i);
+				meter_series.restore(i);
+			};
+		}
+	}
+	catch (std::invalid_argument const& e)
+	{
+		std::cout << e.what() << std::endl;
+		showUsage(std::cout);
+		return 1;
+	}
+
+	// Captures the checkpoint shows are done are skipped
+	bool resuming = false;
+	std::size_t first_capture = 0;
+	if (batch_checkpoint.active())
+	{
+		try
+		{
+			resuming = batch_checkpoint.resume(options.filenames);
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while resuming from '" << options.checkpoint << "' : " << e.what() << std::endl;
+			return 1;
+		}
+
+		if (resuming)
+		{
+			first_capture = batch_checkpoint.resumeCapture();
+			std::cout << "Resuming from " << options.filenames[first_capture] << " @" << batch_checkpoint.resumeOffset() << std::endl;
+		}
+	}
+
+	indexed_captures.assign(options.filenames.size(), false);
+	if (queriedByIndex())
+	{
+		for (std::vector<std::string>::size_type capture = 0; capture != options.filenames.size(); ++capture)
+		{
+			try
+			{
+				bool archive = false;
+				indexed_captures[capture] = readCaptureIndex(options.filenames[capture], archive);
+			}
+			catch (std::exception const& e)
+			{
+				std::cout << "Index of '" << options.filenames[capture] << "' not used : " << e.what() << std::endl;
+			}
+		}
+	}
+
+	std::vector<std::string> prefetch;
+	for (std::vector<std::string>::size_type capture = first_capture; capture != options.filenames.size(); ++capture)
+	{
+		if (!indexed_captures[capture])
+		{
+			prefetch.push_back(options.filenames[capture]); // An indexed capture is only read where it could match
+		}
+	}
+	if (capture_window.active() || !options.daemon.empty() || !options.live.empty() || sampled_statistics.active())
+	{
+		// A window or sample is read a little at a time - the whole capture isn't wanted
+		prefetch.clear();
+	}
+	else if (options.bench)
+	{
+		// The benchmark times reading each capture itself - reading ahead would read it twice and skew the other stages
+		prefetch.clear();
+	}
+	else if (options.stitch)
+	{
+		// Read ahead in the order the segments are stitched
+		prefetch.clear();
+		for (auto &stream : stitchSegments(options.filenames))
+		{
+			for (auto &segment : stream)
+			{
+				prefetch.push_back(segment.filename);
+			}
+		}
+	}
+	capture_prefetcher.load = loadCapture;
+	capture_prefetcher.start(prefetch, options.prefetch);
+
+	if (!options.generate.empty())
+	{
+		return generateCapture();
+	}
+
+#ifndef _WIN32
+	if (!options.daemon.empty())
+	{
+		return serveDecodeRequests();
+	}
+
+	if (!options.live.empty())
+	{
+		return decodeLive();
+	}
+#endif
+
+	if (options.bench)
+	{
+		return benchmarkCaptures();
+	}
+
+	if (options.archive)
+	{
+		return archiveCaptures();
+	}
+
+	if (options.index)
+	{
+		return indexCaptures();
+	}
+
+	if (sampled_statistics.active())
+	{
+		return sampleCaptures();
+	}
+
+	if (options.diff)
+	{
+		int result = diffCaptures();
+		writeMetrics();
+		return result;
+	}
+
+	if (options.stitch)
+	{
+		return stitchCaptures();
+	}
+
+	if (message_pipeline.active())
+	{
+		message_pipeline.read = [](const std::string &filename) { return capture_prefetcher.next(filename); };
+		message_pipeline.frame = [](std::vector<BYTE> &bytes) { frameAny(bytes, false); };
+		message_pipeline.parse = parseMessages;
+		message_pipeline.write = [](std::ostream &o, Message &message) { o << message << '\n'; };
+		run_metrics.startFile("");
+		run_metrics.start("pipeline");
+		message_pipeline.run(options.filenames, std::cout);
+		run_metrics.stop(0, message_pipeline.messagesWritten());
+
+		message_pipeline.report(std::cout);
+		writeMetrics();
+		return 0;
+	}
+
+	if (capture_window.active())
+	{
+		for (auto &filename : options.filenames)
+		{
+			run_metrics.startFile(filename);
+			try
+			{
+				decodeWindow(filename);
+			}
+			catch (std::exception const& e)
+			{
+				std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+				messages.clear();
+			}
+		}
+
+		writeMetrics();
+		return 0;
+	}
+
+	for (std::vector<std::string>::size_type capture = first_capture; capture < options.filenames.size(); ++capture)
+	{
+		std::string &filename = options.filenames[capture];
+		run_metrics.startFile(filename);
+
+		try
+		{
+			if (indexed_captures[capture])
+			{
+				decodeIndexed(filename);
+				showMessages();
+				continue;
+			}
+
+			run_metrics.start("read");
+			std::vector<BYTE> bytes = readCapture(filename);
+			run_metrics.stop(bytes.size(), 0);
+
+			if (isCompactArchive(bytes) && (line_error_analysis.active() || pattern_search.active() || batch_checkpoint.active()))
+			{
+				// These look at the status/data pairs themselves, or pick up part way through a capture
+				bytes = expandArchive(bytes);
+			}
+
+			if (batch_checkpoint.active())
+			{
+				checkpoint_capture = capture;
+				if (resuming && (capture == first_capture))
+				{
+					resume_offset = batch_checkpoint.resumeOffset();
+					if (resume_offset > bytes.size())
+					{
+						throw std::runtime_error("Capture is shorter than its checkpoint - it has been replaced");
+					}
+					if (!countedAsFramed() && (resume_offset == ((bytes.size() / 2) * 2)))
+					{
+						// Listed to the end already - including the message that was in progress there
+						resume_offset = 0;
+						continue;
+					}
+				}
+
+				// A listing is only output once the whole capture is framed, so can only be checkpointed then
+				next_checkpoint = countedAsFramed() ? (resume_offset + BatchCheckpoint::INTERVAL_BYTES) : NO_CHECKPOINT;
+			}
+
+			if (line_error_analysis.active())
+			{
+				// Only the status bytes are needed - nothing is framed
+				run_metrics.start("errors");
+				line_error_analysis.start();
+				line_error_analysis.add(bytes.data(), bytes.size() / 2);
+				line_error_analysis.finish();
+				line_error_analysis.report(std::cout);
+				run_metrics.stop(bytes.size(), 0);
+				continue;
+			}
+
+			if (pattern_search.active())
+			{
+				// Only captures with a match need to be framed - and then only to find the messages they are in
+				run_metrics.start("search");
+				search_filename = filename;
+				search_matches = pattern_search.find(bytes);
+				search_matches_index = 0;
+				std::cout << search_matches.size() << " matches" << std::endl;
+				run_metrics.stop(bytes.size(), 0);
+				if (search_matches.empty())
+				{
+					continue;
+				}
+			}
+
+			run_metrics.start("frame");
+			frameAny(bytes, !(pattern_search.active() || repeat_collapser.active()));
+
+			if (repeat_collapser.active())
+			{
+				repeat_collapser.flush();
+			}
+			run_metrics.stop(bytes.size(), frame_progress.framedMessages());
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "Error while processing '" << filename << "' : " << e.what() << std::endl;
+		}
+
+		if (countedAsFramed() || pattern_search.active() || repeat_collapser.active() || line_error_analysis.active())
+		{
+			// Everything was counted or reported as it was framed - there are no messages to parse or display
+			commitCheckpoint(filename);
+			continue;
+		}
+
+		// Parse individual messages
+		showMessages();
+		commitCheckpoint(filename);
+	}
+
+	if (options.statistics)
+	{
+		message_statistics.report(std::cout);
+	}
+	if (options.meters)
+	{
+		reportMeters();
+	}
+	if (link_analysis.active())
+	{
+		link_analysis.report(std::cout);
+	}
+
+	writeMetrics();
+
+	return 0;
+}
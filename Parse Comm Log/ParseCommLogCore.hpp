@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MessageTable.hpp"
+
+// The entry point into the core of Parse Comm Log for a front-end - everything the front-end has to
+// do is turn its command line into narrow strings
+
+// Purpose: Run with the command line arguments (without the program name). Returns the exit code
+int runParseCommLog(const std::vector<std::string> &arguments);
+
+// Purpose: Give the core a way to read the calling thread's allocations, for the allocations --metrics
+// and --bench report. Only a front-end that counts them itself calls it (see AllocationCounter.hpp)
+void countAllocationsWith(void (*counts)(std::uint64_t &count, std::uint64_t &bytes));
+
+// Decoding straight into a table, for front-ends that hand the messages to another language rather
+// than show them. Neither touches any global state, so captures can be decoded on several threads at once
+
+// Purpose: Read a whole capture file. Throws std::runtime_error if it can't be read
+std::vector<unsigned char> loadCapture(const std::string &filename);
+
+// Purpose: Frame and parse a capture (or compact archive) into table, keeping the messages filter
+// wants. Throws std::invalid_argument on a bad filter and std::runtime_error on a bad archive
+void decodeTable(std::vector<unsigned char> &bytes, const std::string &filter, MessageTable &table);
+
+// Purpose: The names of the values the row fields take (directions, description types, line error
+// flags...), so a front-end can publish them without including the headers they are defined in
+std::vector<std::pair<std::string, int>> messageTableNames();
@@ -0,0 +1,16 @@
+// Parse Comm Log - Parse file generated by the AVP communications analyzer page dump
+//
+// POSIX (Linux) command line front-end. Not part of the Visual Studio project - build it with CMake (see
+// CMakeLists.txt), or by hand with the core:
+//
+//   g++ -std=c++14 -O2 ParseCommLogPosix.cpp ParseCommLogCore.cpp -o parse-comm-log -lboost_chrono -lboost_system -pthread
+
+#include "AllocationCounter.hpp"
+#include "CommandLine.hpp"
+#include "ParseCommLogCore.hpp"
+
+int main(int argc, char *argv[])
+{
+	countAllocationsWith(countedAllocations);
+	return runParseCommLog(commandLineArguments(argc, argv));
+}
@@ -0,0 +1,294 @@
+// Parse Comm Log - Parse file generated by the AVP communications analyzer page dump
+//
+// Python extension module front-end. Frames and parses a capture natively and hands the messages to
+// Python as two blocks of memory through the buffer protocol - a table of fixed size rows (see
+// MessageTable.hpp) and the data bytes of every message - so numpy takes them as they are, without a
+// copy or an object per message. Not part of the Visual Studio project - build it with CMake (see
+// CMakeLists.txt), or by hand with the core:
+//
+//   g++ -std=c++14 -O2 -shared -fPIC $(python3-config --includes) ParseCommLogPython.cpp ParseCommLogCore.cpp -o parse_comm_log$(python3-config --extension-suffix) -lboost_chrono -lboost_system -pthread
+//
+// then
+//
+//   import numpy, parse_comm_log
+//   capture = parse_comm_log.decode("IGT_00012952A0BF_SAS1_1419032367.log", filter="lp=72")
+//   rows = numpy.asarray(capture.messages)    # structured array - offset, length, direction, address...
+//   payload = numpy.asarray(capture.payload)  # uint8 - a row's data bytes start at rows["payload"][i]
+//
+// The arrays share the capture's memory and keep it alive. The GIL is released while decoding, so
+// captures can be decoded on several Python threads at once
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ParseCommLogCore.hpp"
+
+struct CaptureObject
+{
+	PyObject_HEAD
+	MessageTable *table;
+};
+
+// A block of a capture's memory - the rows or the payload
+struct CaptureViewObject
+{
+	PyObject_HEAD
+	CaptureObject *capture;
+	bool rows;
+	Py_ssize_t shape[1];
+	Py_ssize_t strides[1];
+};
+
+static PyTypeObject CaptureType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+static PyTypeObject CaptureViewType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+// Purpose: Export the rows or payload read-only. Refuses a writable buffer - the table is shared
+static int getCaptureViewBuffer(PyObject *object, Py_buffer *view, int flags)
+{
+	CaptureViewObject *self = (CaptureViewObject *)object;
+	MessageTable &table = *self->capture->table;
+
+	if (flags & PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "A decoded capture is read-only");
+		return -1;
+	}
+
+	static char empty = { 0 }; // Somewhere to point at when there is nothing
+	if (self->rows)
+	{
+		view->buf = table.rows.empty() ? (void *)&empty : (void *)table.rows.data();
+		view->itemsize = sizeof(MessageRow);
+		view->format = (flags & PyBUF_FORMAT) ? (char *)MESSAGE_ROW_FORMAT : nullptr;
+		self->shape[0] = (Py_ssize_t)table.rows.size();
+	}
+	else
+	{
+		view->buf = table.payload.empty() ? (void *)&empty : (void *)table.payload.data();
+		view->itemsize = 1;
+		view->format = (flags & PyBUF_FORMAT) ? (char *)"B" : nullptr;
+		self->shape[0] = (Py_ssize_t)table.payload.size();
+	}
+	self->strides[0] = view->itemsize;
+
+	view->obj = object;
+	Py_INCREF(object);
+	view->len = self->shape[0] * view->itemsize;
+	view->readonly = 1;
+	view->ndim = 1;
+	view->shape = ((flags & PyBUF_ND) == PyBUF_ND) ? self->shape : nullptr;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+	return 0;
+}
+
+static PyBufferProcs capture_view_buffer_procs = { getCaptureViewBuffer, nullptr };
+
+static void deallocCaptureView(PyObject *object)
+{
+	CaptureViewObject *self = (CaptureViewObject *)object;
+	Py_XDECREF((PyObject *)self->capture);
+	Py_TYPE(object)->tp_free(object);
+}
+
+// Purpose: A view of the rows or payload that keeps the capture alive for as long as it is exported
+static PyObject *newCaptureView(CaptureObject *capture, bool rows)
+{
+	CaptureViewObject *view = PyObject_New(CaptureViewObject, &CaptureViewType);
+	if (!view)
+	{
+		return nullptr;
+	}
+	Py_INCREF((PyObject *)capture);
+	view->capture = capture;
+	view->rows = rows;
+	view->shape[0] = 0;
+	view->strides[0] = 0;
+	return (PyObject *)view;
+}
+
+static void deallocCapture(PyObject *object)
+{
+	CaptureObject *self = (CaptureObject *)object;
+	delete self->table;
+	Py_TYPE(object)->tp_free(object);
+}
+
+static Py_ssize_t captureLength(PyObject *object)
+{
+	return (Py_ssize_t)((CaptureObject *)object)->table->rows.size();
+}
+
+static PyObject *captureMessages(PyObject *object, void *)
+{
+	return newCaptureView((CaptureObject *)object, true);
+}
+
+static PyObject *capturePayload(PyObject *object, void *)
+{
+	return newCaptureView((CaptureObject *)object, false);
+}
+
+static PySequenceMethods capture_sequence_methods = { captureLength };
+
+static PyGetSetDef capture_getset[] =
+{
+	{ (char *)"messages", captureMessages, nullptr, (char *)"The messages - one row each, in the order they were framed", nullptr },
+	{ (char *)"payload", capturePayload, nullptr, (char *)"The data bytes of every message, one message after another", nullptr },
+	{ nullptr }
+};
+
+// Purpose: decode(capture, filter=None) - capture is a file name or the bytes of a capture, filter an
+// expression as --filter takes
+static PyObject *decode(PyObject *, PyObject *arguments, PyObject *keywords)
+{
+	static const char *keyword_names[] = { "capture", "filter", nullptr };
+	PyObject *source = nullptr;
+	const char *filter = nullptr;
+	if (!PyArg_ParseTupleAndKeywords(arguments, keywords, "O|z", (char **)keyword_names, &source, &filter))
+	{
+		return nullptr;
+	}
+
+	std::string filename;
+	std::vector<unsigned char> bytes;
+	if (PyObject_CheckBuffer(source))
+	{
+		Py_buffer buffer;
+		if (PyObject_GetBuffer(source, &buffer, PyBUF_SIMPLE) != 0)
+		{
+			return nullptr;
+		}
+		bytes.assign((unsigned char *)buffer.buf, (unsigned char *)buffer.buf + buffer.len);
+		PyBuffer_Release(&buffer);
+	}
+	else
+	{
+		PyObject *encoded = nullptr;
+		if (!PyUnicode_FSConverter(source, &encoded))
+		{
+			return nullptr;
+		}
+		filename = PyBytes_AS_STRING(encoded);
+		Py_DECREF(encoded);
+	}
+
+	MessageTable *table = new (std::nothrow) MessageTable;
+	if (!table)
+	{
+		return PyErr_NoMemory();
+	}
+
+	// Decode without the GIL, keeping what went wrong to raise once it is held again
+	PyObject *error_type = nullptr;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+	try
+	{
+		if (!filename.empty())
+		{
+			error_type = PyExc_OSError;
+			bytes = loadCapture(filename);
+		}
+		error_type = PyExc_RuntimeError;
+		decodeTable(bytes, filter ? filter : "", *table);
+		error_type = nullptr;
+	}
+	catch (std::invalid_argument const& e)
+	{
+		error_type = PyExc_ValueError;
+		error = e.what();
+	}
+	catch (std::bad_alloc const&)
+	{
+		error_type = PyExc_MemoryError;
+	}
+	catch (std::exception const& e)
+	{
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+
+	if (error_type)
+	{
+		delete table;
+		if (error_type == PyExc_MemoryError)
+		{
+			return PyErr_NoMemory();
+		}
+		if (error_type == PyExc_OSError)
+		{
+			error = "'" + filename + "' : " + error;
+		}
+		PyErr_SetString(error_type, error.c_str());
+		return nullptr;
+	}
+
+	CaptureObject *capture = PyObject_New(CaptureObject, &CaptureType);
+	if (!capture)
+	{
+		delete table;
+		return nullptr;
+	}
+	capture->table = table;
+	return (PyObject *)capture;
+}
+
+static PyMethodDef module_methods[] =
+{
+	{ "decode", (PyCFunction)(void (*)(void))decode, METH_VARARGS | METH_KEYWORDS,
+		"decode(capture, filter=None) -> Capture\n\nFrame and parse a capture file (or the bytes of one) natively" },
+	{ nullptr }
+};
+
+static PyModuleDef module_definition = { PyModuleDef_HEAD_INIT, "parse_comm_log", "Decode AVP communications analyzer captures", -1, module_methods };
+
+PyMODINIT_FUNC PyInit_parse_comm_log()
+{
+	CaptureType.tp_name = "parse_comm_log.Capture";
+	CaptureType.tp_basicsize = sizeof(CaptureObject);
+	CaptureType.tp_flags = Py_TPFLAGS_DEFAULT;
+	CaptureType.tp_doc = "A decoded capture - see messages and payload";
+	CaptureType.tp_dealloc = deallocCapture;
+	CaptureType.tp_as_sequence = &capture_sequence_methods;
+	CaptureType.tp_getset = capture_getset;
+
+	CaptureViewType.tp_name = "parse_comm_log.CaptureView";
+	CaptureViewType.tp_basicsize = sizeof(CaptureViewObject);
+	CaptureViewType.tp_flags = Py_TPFLAGS_DEFAULT;
+	CaptureViewType.tp_doc = "Rows or payload of a decoded capture, for numpy.asarray or memoryview";
+	CaptureViewType.tp_dealloc = deallocCaptureView;
+	CaptureViewType.tp_as_buffer = &capture_view_buffer_procs;
+
+	if ((PyType_Ready(&CaptureType) < 0) || (PyType_Ready(&CaptureViewType) < 0))
+	{
+		return nullptr;
+	}
+
+	PyObject *module = PyModule_Create(&module_definition);
+	if (!module)
+	{
+		return nullptr;
+	}
+
+	Py_INCREF((PyObject *)&CaptureType);
+	if ((PyModule_AddObject(module, "Capture", (PyObject *)&CaptureType) < 0) ||
+		(PyModule_AddStringConstant(module, "MESSAGE_ROW_FORMAT", MESSAGE_ROW_FORMAT) < 0))
+	{
+		Py_DECREF(module);
+		return nullptr;
+	}
+	for (auto &name : messageTableNames())
+	{
+		if (PyModule_AddIntConstant(module, name.first.c_str(), name.second) < 0)
+		{
+			Py_DECREF(module);
+			return nullptr;
+		}
+	}
+	return module;
+}
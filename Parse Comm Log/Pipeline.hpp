@@ -0,0 +1,369 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Allocations.hpp"
+#include "ParseCommLog.hpp"
+
+// Read, frame, parse and write as a pipeline - each stage on its own thread, handing batches of
+// messages to the next through a bounded lock-free single producer/single consumer ring. A stage that
+// gets ahead blocks on a full ring (backpressure) so memory stays bounded, and the run takes about as
+// long as the slowest stage rather than the sum of them all
+//
+// Formatting is done by the write stage as the text goes out - the console colours are set with
+// SetConsoleTextAttribute as a message is streamed, so they can't be formatted ahead into a buffer
+
+// Purpose: Bounded queue between exactly one producer thread and one consumer thread
+template <typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(std::size_t capacity)
+		:slots(capacity + 1) // One slot is always left empty to tell full from empty
+	{
+	}
+
+	// Purpose: Add an item, waiting while the ring is full. Returns the seconds spent waiting
+	double push(T &&item)
+	{
+		std::size_t tail = write_index.load(std::memory_order_relaxed);
+		std::size_t next = advance(tail);
+
+		double waited = 0;
+		if (next == read_index.load(std::memory_order_acquire))
+		{
+			boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+			while (next == read_index.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+			waited = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+		}
+
+		slots[tail] = std::move(item);
+		write_index.store(next, std::memory_order_release);
+		return waited;
+	}
+
+	// Purpose: Take the oldest item, waiting while the ring is empty. Returns false once the ring is
+	// empty and closed. Adds the seconds spent waiting to waited
+	bool pop(T &item, double &waited)
+	{
+		std::size_t head = read_index.load(std::memory_order_relaxed);
+
+		if (head == write_index.load(std::memory_order_acquire))
+		{
+			boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+			while (head == write_index.load(std::memory_order_acquire))
+			{
+				if (closed.load(std::memory_order_acquire) && (head == write_index.load(std::memory_order_acquire)))
+				{
+					waited += boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+					return false;
+				}
+				std::this_thread::yield();
+			}
+			waited += boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+		}
+
+		item = std::move(slots[head]);
+		read_index.store(advance(head), std::memory_order_release);
+		return true;
+	}
+
+	// Purpose: The producer has nothing more to add
+	void close() { closed.store(true, std::memory_order_release); }
+
+private:
+	std::size_t advance(std::size_t index) const { return ((index + 1) == slots.size()) ? 0 : index + 1; }
+
+	std::vector<T> slots;
+	std::atomic<std::size_t> read_index = { 0 };
+	std::atomic<std::size_t> write_index = { 0 };
+	std::atomic<bool> closed = { false };
+};
+
+// A capture read from disk, on its way to the framer
+struct PipelineCapture
+{
+	std::string filename;
+	std::vector<BYTE> bytes;
+	std::string error;          // Why the capture couldn't be read (empty if it was)
+};
+
+enum class BatchType
+{
+	START_OF_CAPTURE,
+	MESSAGES,
+	END_OF_CAPTURE
+};
+
+struct MessageBatch
+{
+	BatchType type;
+	std::string filename;       // START_OF_CAPTURE, END_OF_CAPTURE
+	std::string error;          // END_OF_CAPTURE - why the capture couldn't be processed
+	std::vector<Message> messages;
+};
+
+// Where a stage spent its time
+struct StageTiming
+{
+	const char *name;
+	double total = { 0 };       // Seconds from the stage starting to it finishing
+	double waiting = { 0 };     // Seconds blocked on an empty input or a full output ring
+	std::uint64_t items = { 0 };
+};
+
+class MessagePipeline
+{
+public:
+	// The work each stage does - set before run()
+	std::function<std::vector<BYTE>(const std::string &)> read;
+	std::function<void(std::vector<BYTE> &)> frame;     // Calls framed() with each message
+	std::function<void(std::vector<Message> &)> parse;
+	std::function<void(std::ostream &, Message &)> write;
+
+	MessagePipeline()
+		:captures(CAPTURES_IN_FLIGHT),
+		framed_batches(BATCHES_IN_FLIGHT),
+		parsed_batches(BATCHES_IN_FLIGHT)
+	{
+		timings[READ].name = "read";
+		timings[FRAME].name = "frame";
+		timings[PARSE].name = "parse";
+		timings[WRITE].name = "write";
+	}
+
+	void enable() { enabled = true; }
+
+	bool active() const { return enabled; }
+
+	// Purpose: Called by the frame stage with each message that is to be shown
+	void framed(Message &message)
+	{
+		batch.messages.push_back(message);
+		if (batch.messages.size() == BATCH_MESSAGES)
+		{
+			sendBatch();
+		}
+	}
+
+	// Purpose: Read, frame, parse and write every capture, in order. The write stage runs on the calling thread
+	void run(const std::vector<std::string> &filenames, std::ostream &o)
+	{
+		boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+		std::thread reader(&MessagePipeline::readStage, this, std::cref(filenames));
+		std::thread framer(&MessagePipeline::frameStage, this);
+		std::thread parser(&MessagePipeline::parseStage, this);
+
+		writeStage(o);
+
+		parser.join();
+		framer.join();
+		reader.join();
+
+		wall = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+	}
+
+	std::uint64_t messagesWritten() const { return timings[WRITE].items; }
+
+	void report(std::ostream &o)
+	{
+		o << std::dec << std::setfill(' ') << std::fixed << std::setprecision(3)
+			<< "Stage       busy (s)   waiting (s)      items" << std::endl;
+		for (auto &timing : timings)
+		{
+			o << std::left << std::setw(8) << timing.name << std::right
+				<< std::setw(12) << (timing.total - timing.waiting)
+				<< std::setw(14) << timing.waiting
+				<< std::setw(11) << timing.items << std::endl;
+		}
+		o << "wall " << wall << " s" << std::endl;
+		o.unsetf(std::ios::fixed);
+	}
+
+private:
+	void readStage(const std::vector<std::string> &filenames)
+	{
+		StageClock clock(timings[READ]);
+		AllocationCredit allocations; // The run is measured on the thread that started the pipeline
+
+		for (auto &filename : filenames)
+		{
+			PipelineCapture capture;
+			capture.filename = filename;
+			try
+			{
+				capture.bytes = read(filename);
+			}
+			catch (std::exception const& e)
+			{
+				capture.error = e.what();
+			}
+
+			++timings[READ].items;
+			timings[READ].waiting += captures.push(std::move(capture));
+		}
+		captures.close();
+	}
+
+	void frameStage()
+	{
+		StageClock clock(timings[FRAME]);
+		AllocationCredit allocations; // The run is measured on the thread that started the pipeline
+
+		PipelineCapture capture;
+		while (captures.pop(capture, timings[FRAME].waiting))
+		{
+			MessageBatch marker;
+			marker.type = BatchType::START_OF_CAPTURE;
+			marker.filename = capture.filename;
+			timings[FRAME].waiting += framed_batches.push(std::move(marker));
+
+			std::string error = capture.error;
+			if (error.empty())
+			{
+				try
+				{
+					frame(capture.bytes);
+				}
+				catch (std::exception const& e)
+				{
+					error = e.what();
+				}
+			}
+			sendBatch();
+
+			marker = MessageBatch();
+			marker.type = BatchType::END_OF_CAPTURE;
+			marker.filename = capture.filename;
+			marker.error = error;
+			timings[FRAME].waiting += framed_batches.push(std::move(marker));
+		}
+		framed_batches.close();
+	}
+
+	void parseStage()
+	{
+		StageClock clock(timings[PARSE]);
+		AllocationCredit allocations; // The run is measured on the thread that started the pipeline
+
+		MessageBatch parsing;
+		while (framed_batches.pop(parsing, timings[PARSE].waiting))
+		{
+			parse(parsing.messages);
+			timings[PARSE].items += parsing.messages.size();
+			timings[PARSE].waiting += parsed_batches.push(std::move(parsing));
+		}
+		parsed_batches.close();
+	}
+
+	void writeStage(std::ostream &o)
+	{
+		StageClock clock(timings[WRITE]);
+
+		std::uint64_t capture_messages = 0;
+		MessageBatch writing;
+		while (parsed_batches.pop(writing, timings[WRITE].waiting))
+		{
+			switch (writing.type)
+			{
+			case BatchType::START_OF_CAPTURE:
+				o << "Open " << writing.filename << std::endl;
+				capture_messages = 0;
+				break;
+
+			case BatchType::MESSAGES:
+				for (auto &message : writing.messages)
+				{
+					write(o, message);
+				}
+				capture_messages += writing.messages.size();
+				timings[WRITE].items += writing.messages.size();
+				break;
+
+			case BatchType::END_OF_CAPTURE:
+				if (!writing.error.empty())
+				{
+					o << "Error while processing '" << writing.filename << "' : " << writing.error << std::endl;
+				}
+				o << std::dec << capture_messages << " messages" << std::endl;
+				break;
+			}
+		}
+	}
+
+	// Purpose: Hand the messages framed so far on to the parse stage
+	void sendBatch()
+	{
+		if (batch.messages.empty())
+		{
+			return;
+		}
+
+		batch.type = BatchType::MESSAGES;
+		timings[FRAME].items += batch.messages.size();
+		timings[FRAME].waiting += framed_batches.push(std::move(batch));
+		batch = MessageBatch();
+		batch.messages.reserve(BATCH_MESSAGES);
+	}
+
+	// Purpose: Time a stage from construction to destruction
+	class StageClock
+	{
+	public:
+		explicit StageClock(StageTiming &timing)
+			:timing(timing),
+			start(boost::chrono::steady_clock::now())
+		{
+		}
+
+		~StageClock()
+		{
+			timing.total = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		StageTiming &timing;
+		boost::chrono::steady_clock::time_point start;
+	};
+
+	enum Stage
+	{
+		READ,
+		FRAME,
+		PARSE,
+		WRITE,
+		STAGES
+	};
+
+	// Messages handed from one stage to the next at a time
+	static const std::size_t BATCH_MESSAGES = { 1024 };
+
+	// Ring sizes - what a stage can get ahead of the next by before it has to wait
+	static const std::size_t CAPTURES_IN_FLIGHT = { 2 };
+	static const std::size_t BATCHES_IN_FLIGHT = { 16 };
+
+	bool enabled = { false };
+
+	SpscRing<PipelineCapture> captures;
+	SpscRing<MessageBatch> framed_batches;
+	SpscRing<MessageBatch> parsed_batches;
+
+	MessageBatch batch;         // Being filled by the frame stage
+
+	StageTiming timings[STAGES];
+	double wall = { 0 };
+};
+
+MessagePipeline message_pipeline;
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Allocations.hpp"
+#include <boost/chrono.hpp>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+#include "ParseCommLog.hpp"
+
+// Read captures ahead of when they are wanted. Up to depth files are being opened and read at once,
+// each on its own thread, so when the captures are on a slow share the time spent waiting for one
+// file overlaps the others instead of adding up. Captures are handed out in the order they were
+// listed, whichever finishes reading first
+
+class CapturePrefetcher
+{
+public:
+	// Loads a whole capture - called on a background thread
+	std::function<std::vector<BYTE>(const std::string &)> load;
+
+	// Purpose: Start reading the first depth captures of the list
+	void start(const std::vector<std::string> &filenames, std::size_t depth)
+	{
+		queued = filenames;
+		next_file = 0;
+		in_flight.clear();
+		maximum_in_flight = depth;
+
+		launch();
+	}
+
+	// Purpose: Get the next capture - waiting for it if it hasn't finished reading. Rethrows whatever the
+	// read threw. A capture asked for out of order is simply read there and then
+	std::vector<BYTE> next(const std::string &filename)
+	{
+		Loaded loaded;
+		if (in_flight.empty() || (in_flight.front().filename != filename))
+		{
+			loaded = timedLoad(load, filename);
+		}
+		else
+		{
+			std::future<Loaded> pending = std::move(in_flight.front().loaded);
+			in_flight.pop_front();
+			launch();
+
+			loaded = pending.get();
+			AllocationSnapshot::credit(loaded.allocations); // To the stage it is handed to, not whatever was running when it was read
+		}
+
+		read_seconds = loaded.seconds;
+		return std::move(loaded.bytes);
+	}
+
+	// Seconds the capture next handed out last took to read - on whichever thread read it
+	double readSeconds() const { return read_seconds; }
+
+private:
+	struct Loaded
+	{
+		std::vector<BYTE> bytes;
+		double seconds;
+		AllocationSnapshot allocations;  // Made reading it - on the thread that read it
+	};
+
+	struct Pending
+	{
+		std::string filename;
+		std::future<Loaded> loaded;
+	};
+
+	// Purpose: Load a capture, timing it and counting its allocations where it is read rather than where
+	// it is waited for
+	static Loaded timedLoad(std::function<std::vector<BYTE>(const std::string &)> load, const std::string &filename)
+	{
+		boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+		AllocationSnapshot before = AllocationSnapshot::onThisThread();
+		Loaded loaded;
+		loaded.bytes = load(filename);
+		loaded.allocations = AllocationSnapshot::onThisThread().since(before);
+		boost::chrono::duration<double> sec = boost::chrono::steady_clock::now() - start;
+		loaded.seconds = sec.count();
+		return loaded;
+	}
+
+	void launch()
+	{
+		while ((in_flight.size() < maximum_in_flight) && (next_file != queued.size()))
+		{
+			Pending pending;
+			pending.filename = queued[next_file++];
+			pending.loaded = std::async(std::launch::async, timedLoad, load, pending.filename);
+			in_flight.push_back(std::move(pending));
+		}
+	}
+
+	std::vector<std::string> queued;
+	std::vector<std::string>::size_type next_file = { 0 };
+	std::deque<Pending> in_flight;
+	std::size_t maximum_in_flight = { 0 };
+	double read_seconds = { 0 };
+};
+
+CapturePrefetcher capture_prefetcher;
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <boost/chrono.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Progress of framing a capture, shown by a thread of its own. The framer only stores how far it has
+// got in relaxed atomics - no clock reads or console output in the loop - and the reporter samples
+// them a few times a second to show the rate and time left. Output that isn't going to a console
+// (e.g. redirected to a file) gets no progress at all
+
+// Purpose: Is the output going to a console rather than a file or a pipe
+inline bool outputIsConsole()
+{
+#ifdef _WIN32
+	return _isatty(_fileno(stdout)) != 0;
+#else
+	return isatty(fileno(stdout)) != 0;
+#endif
+}
+
+class ProgressReporter
+{
+public:
+	~ProgressReporter()
+	{
+		stop();
+	}
+
+	// Purpose: Start showing progress through total bytes. Stops any earlier progress still showing (e.g.
+	// when the framer threw)
+	void start(std::uint64_t total)
+	{
+		stop();
+
+		if (!outputIsConsole())
+		{
+			return;
+		}
+
+		total_bytes = total;
+		stopping = false;
+		reporter = std::thread(&ProgressReporter::report, this);
+	}
+
+	// Purpose: Stop showing progress and clear the progress line
+	void stop()
+	{
+		if (!reporter.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		reporter.join();
+
+		std::cout << '\r' << std::string(last_width, ' ') << '\r' << std::flush;
+		last_width = 0;
+	}
+
+	// Purpose: Start counting a new capture - whether or not progress is being shown
+	void reset()
+	{
+		bytes.store(0, std::memory_order_relaxed);
+		messages.store(0, std::memory_order_relaxed);
+	}
+
+	std::uint64_t framedMessages() const { return messages.load(std::memory_order_relaxed); }
+
+	// Purpose: Called by the framer as it goes - only the framer writes these
+	void setBytes(std::uint64_t done) { bytes.store(done, std::memory_order_relaxed); }
+	void countMessage() { messages.store(messages.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+private:
+	void report()
+	{
+		static const char SPINNER[] = { '/', '-', '\\', '|' };
+
+		boost::chrono::steady_clock::time_point started = boost::chrono::steady_clock::now();
+		unsigned int ticks = 0;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!wake.wait_for(lock, std::chrono::milliseconds(INTERVAL_MS), [this] { return stopping; }))
+		{
+			std::uint64_t done = bytes.load(std::memory_order_relaxed);
+			double seconds = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - started).count();
+			double rate = (seconds > 0) ? (done / seconds) : 0;
+
+			std::ostringstream line;
+			line << '\r' << SPINNER[ticks++ % 4] << ' '
+				<< std::fixed << std::setprecision(1) << (rate / (1024 * 1024)) << " MB/s  "
+				<< std::setprecision(0) << (total_bytes ? ((100.0 * done) / total_bytes) : 100.0) << "%  "
+				<< messages.load(std::memory_order_relaxed) << " messages";
+			if (rate > 0)
+			{
+				line << "  " << ((total_bytes - done) / rate) << " s left";
+			}
+
+			std::string text = line.str();
+			std::size_t width = text.size();
+			if (width < last_width)
+			{
+				text += std::string(last_width - width, ' ');
+			}
+			last_width = width;
+
+			std::cout << text << std::flush;
+		}
+	}
+
+	// How often the progress line is redrawn
+	static const int INTERVAL_MS = { 250 };
+
+	std::atomic<std::uint64_t> bytes = { 0 };
+	std::atomic<std::uint64_t> messages = { 0 };
+	std::uint64_t total_bytes = { 0 };
+
+	std::thread reporter;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = { false };
+	std::size_t last_width = { 0 };
+};
+
+const int ProgressReporter::INTERVAL_MS;
+
+ProgressReporter frame_progress;
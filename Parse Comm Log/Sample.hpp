@@ -0,0 +1,608 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Archive.hpp"
+#include "ParseCommLog.hpp"
+
+// Sampled statistics - estimates of what --stats would count, from a random share of each capture.
+// Each capture is cut into fixed size chunks and a simple random sample of them is framed. Framing
+// picks up at an arbitrary chunk by resyncing: back to the last request (an RX'd byte with the wakeup
+// bit, which always starts a message) before the chunk, so every message is framed and stamped just
+// as it would be from the start of the capture, and on to the next request after it, so the last
+// message is whole. Chunks start on a status/data pair, so they are never out of phase. A message
+// belongs to the chunk it starts in
+//
+// Each capture is a stratum and each chunk a cluster of messages. Totals are the chunk means scaled
+// up to every chunk, with their variance from how much the counts vary between chunks of the same
+// capture (with the finite population correction - a capture sampled in full adds nothing). Shares
+// and rates are ratios of two such totals, with the usual linearised variance. Intervals are 95%, from
+// Student's t with the Satterthwaite degrees of freedom of the total - honest, but wide, when only a
+// few chunks of a few captures are sampled
+//
+//   settings := setting { ',' setting }
+//
+//   share=1      percentage of the chunks of each capture to frame - at least 2 are always framed
+//   chunk=256    chunk size in KB
+//   seed=1       seed of the random choice of chunks - the same seed picks the same chunks
+
+struct SampleSettings
+{
+	double share = { 1 };
+	std::uint64_t chunk_bytes = { 256 * 1024 };
+	std::uint64_t seed = { 1 };
+};
+
+// Purpose: Build the sample settings (see above). Throws std::invalid_argument on bad settings
+inline SampleSettings parseSampleSettings(const std::string &settings)
+{
+	SampleSettings sample;
+
+	std::string::size_type start = 0;
+	while (start < settings.size())
+	{
+		std::string::size_type end = settings.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = settings.size();
+		}
+
+		std::string setting = settings.substr(start, end - start);
+		std::string::size_type equals = setting.find('=');
+		if (equals == std::string::npos)
+		{
+			throw std::invalid_argument("Sample setting '" + setting + "' is missing '='");
+		}
+
+		std::string key = setting.substr(0, equals);
+		std::string value = setting.substr(equals + 1);
+		std::size_t used = 0;
+		double number = 0;
+		try
+		{
+			number = std::stod(value, &used);
+		}
+		catch (std::exception const&)
+		{
+			used = 0;
+		}
+		if (value.empty() || (used != value.size()) || (number < 0))
+		{
+			throw std::invalid_argument("Sample setting '" + setting + "' needs a number");
+		}
+
+		if (key == "share")
+		{
+			if ((number <= 0) || (number > 100))
+			{
+				throw std::invalid_argument("Sample setting '" + setting + "' must be a percentage above 0");
+			}
+			sample.share = number;
+		}
+		else if (key == "chunk")
+		{
+			if ((number < 1) || (number != std::floor(number)))
+			{
+				throw std::invalid_argument("Sample setting '" + setting + "' needs a whole number of KB");
+			}
+			sample.chunk_bytes = (std::uint64_t)number * 1024;
+		}
+		else if (key == "seed")
+		{
+			sample.seed = (std::uint64_t)number;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown sample setting '" + key + "'");
+		}
+
+		start = end + 1;
+	}
+
+	return sample;
+}
+
+// The status/data pairs of a capture, read a range at a time - from the capture itself, or unpacked
+// from the blocks of a compact archive of it
+class SampleSource
+{
+public:
+	// Purpose: Open a capture or compact archive. Throws std::runtime_error if it can't be read
+	void open(const std::string &filename)
+	{
+		archive.reset();
+		archive_bytes.clear();
+		unpacked_block = NO_BLOCK;
+
+		file.close();
+		file.clear();
+		file.open(filename, std::ios::in | std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("File could not be opened");
+		}
+
+		file.seekg(0, std::ios::end);
+		std::uint64_t size = (std::uint64_t)file.tellg();
+		file.seekg(0, std::ios::beg);
+
+		char magic[sizeof(COMPACT_MAGIC)];
+		if (file.read(magic, sizeof(magic)) && (std::memcmp(magic, COMPACT_MAGIC, sizeof(magic)) == 0))
+		{
+			// Only the blocks the sample needs are unpacked, but they are found from the index at the end
+			archive_bytes.resize((std::size_t)size);
+			file.seekg(0, std::ios::beg);
+			if (!file.read((char *)archive_bytes.data(), archive_bytes.size()))
+			{
+				throw std::runtime_error("File could not be read");
+			}
+			bytes_read += archive_bytes.size();
+			archive.reset(new CompactArchive(archive_bytes));
+			block_pairs = (std::uint64_t)getNumber(&archive_bytes[8], 4); // Every block holds this many, but the last
+			capture_bytes = archive->pairs() * 2;
+		}
+		else
+		{
+			capture_bytes = (size / 2) * 2;
+		}
+		file.clear();
+	}
+
+	// Bytes of the capture - of the capture an archive holds, not of the archive
+	std::uint64_t size() const { return capture_bytes; }
+
+	// Bytes read from the files opened so far
+	std::uint64_t fileBytesRead() const { return bytes_read; }
+
+	// Purpose: Read the pairs at capture offsets [from, to) - both even
+	std::vector<BYTE> read(std::uint64_t from, std::uint64_t to)
+	{
+		std::vector<BYTE> bytes((std::size_t)(to - from));
+		if (!archive)
+		{
+			file.clear();
+			file.seekg((std::streamoff)from);
+			if (!bytes.empty() && !file.read((char *)bytes.data(), bytes.size()))
+			{
+				throw std::runtime_error("File could not be read");
+			}
+			bytes_read += bytes.size();
+			return bytes;
+		}
+
+		for (std::uint64_t pair = from / 2; pair != to / 2;)
+		{
+			std::size_t block = (std::size_t)(pair / block_pairs);
+			if (block != unpacked_block)
+			{
+				archive->unpackBlock(block, status, data);
+				unpacked_block = block;
+			}
+
+			std::uint64_t first = archive->firstPair(block);
+			std::uint64_t last = first + status.size();
+			for (; (pair != last) && (pair != to / 2); ++pair)
+			{
+				std::size_t i = (std::size_t)(pair - (from / 2)) * 2;
+				bytes[i] = status[(std::size_t)(pair - first)];
+				bytes[i + 1] = data[(std::size_t)(pair - first)];
+			}
+		}
+		return bytes;
+	}
+
+	// Purpose: Read the chunk at capture offsets [from, to) to frame it - widened back to the last request
+	// at or before it and on to the first request at or after its end, or to the ends of the capture.
+	// Sets frame_from to the capture offset of the first pair
+	std::vector<BYTE> readResynced(std::uint64_t from, std::uint64_t to, std::uint64_t &frame_from)
+	{
+		for (std::uint64_t margin = RESYNC_BYTES;; margin *= 2)
+		{
+			std::uint64_t read_from = (from > margin) ? (from - margin) : 0;
+			std::uint64_t read_to = ((capture_bytes - to) > margin) ? (to + margin) : capture_bytes;
+			std::vector<BYTE> bytes = read(read_from, read_to);
+
+			std::size_t first = (std::size_t)(from - read_from);
+			while (first && !startsRequest(bytes[first]))
+			{
+				first -= 2;
+			}
+			std::size_t last = (std::size_t)(to - read_from);
+			while ((last != bytes.size()) && !startsRequest(bytes[last]))
+			{
+				last += 2;
+			}
+
+			if ((startsRequest(bytes[first]) || !read_from) && ((last != bytes.size()) || (read_to == capture_bytes)))
+			{
+				frame_from = read_from + first;
+				bytes.erase(bytes.begin() + last, bytes.end());
+				bytes.erase(bytes.begin(), bytes.begin() + first);
+				return bytes;
+			}
+		}
+	}
+
+private:
+	// Bytes either side of a chunk read to resync in - a request is rarely more than a few messages away
+	static const std::uint64_t RESYNC_BYTES = { 4096 };
+	static const std::size_t NO_BLOCK = { ~(std::size_t)0 };
+
+	// Purpose: Does a pair start a request - an RX'd byte with the wakeup bit, which always starts a message
+	static bool startsRequest(BYTE status)
+	{
+		StatusAndData status_and_data(status, 0);
+		return status_and_data.rx() && status_and_data.addressByte();
+	}
+
+	std::ifstream file;
+	std::uint64_t capture_bytes = { 0 };
+	std::uint64_t bytes_read = { 0 };
+
+	std::vector<BYTE> archive_bytes;
+	std::unique_ptr<CompactArchive> archive;
+	std::uint64_t block_pairs = { 1 };
+	std::vector<BYTE> status;
+	std::vector<BYTE> data;
+	std::size_t unpacked_block = { NO_BLOCK };
+};
+
+class SampledStatistics
+{
+public:
+	// Purpose: Sample with these settings (see above)
+	void set(const SampleSettings &sample_settings)
+	{
+		settings = sample_settings;
+		random.seed(settings.seed);
+		enabled = true;
+	}
+
+	bool active() const { return enabled; }
+
+	std::uint64_t chunkBytes() const { return settings.chunk_bytes; }
+
+	// Purpose: Choose the chunks to frame from a capture of capture_bytes, in capture order. Starts the
+	// capture's stratum
+	std::vector<std::uint64_t> pickChunks(std::uint64_t capture_bytes)
+	{
+		std::uint64_t chunks = (capture_bytes + settings.chunk_bytes - 1) / settings.chunk_bytes;
+		std::uint64_t wanted = (std::uint64_t)std::ceil(chunks * settings.share / 100);
+		wanted = (wanted < 2) ? 2 : wanted;
+		wanted = (wanted > chunks) ? chunks : wanted;
+
+		// Selection sampling - each chunk is taken with the chance of filling the places still open
+		std::vector<std::uint64_t> picked;
+		std::uniform_real_distribution<double> uniform(0, 1);
+		for (std::uint64_t chunk = 0; (chunk != chunks) && (picked.size() != wanted); ++chunk)
+		{
+			if ((chunks - chunk) * uniform(random) < (wanted - picked.size()))
+			{
+				picked.push_back(chunk);
+			}
+		}
+
+		stratum_chunks = chunks;
+		stratum_sampled = 0; // Whatever a capture that failed part way through left behind
+		stratum_sums.fill(0);
+		stratum_squares.fill(0);
+		stratum_products.fill(0);
+		total_chunks += chunks;
+		return picked;
+	}
+
+	// Purpose: Start counting the messages that start at capture offsets [from, to)
+	void startChunk(std::uint64_t from, std::uint64_t to)
+	{
+		chunk_from = from;
+		chunk_to = to;
+		counts.fill(0);
+	}
+
+	// Purpose: Count a framed message, if it starts in the chunk being sampled. Must see every message
+	// framed from the resync point, in order
+	void add(Message &message)
+	{
+		if ((message.offset < chunk_from) || (message.offset >= chunk_to))
+		{
+			return;
+		}
+
+		auto &bytes = message.raw_status_and_data_bytes;
+
+		++counts[MESSAGES];
+		counts[BYTES] += bytes.size();
+		for (auto &status_and_data : bytes)
+		{
+			counts[ADDRESS_BYTES] += status_and_data.status.parity_error; // The wakeup bit, not an error
+			counts[FRAMING_ERRORS] += status_and_data.status.framing_error;
+			counts[OVERRUN_ERRORS] += status_and_data.status.overrun_error;
+			counts[BREAK_ERRORS] += status_and_data.status.break_error;
+		}
+
+		switch (message.direction)
+		{
+		case Direction::RX:
+			++counts[RX_MESSAGES];
+			if (!bytes[0].addressByte())
+			{
+				++counts[MISSING_START];
+			}
+			else if (bytes[0].broadcastPoll())
+			{
+				++counts[BROADCAST_POLLS];
+			}
+			else if (bytes[0].generalPoll())
+			{
+				++counts[GENERAL_POLLS];
+			}
+			else if (bytes.size() > 1)
+			{
+				++counts[LONG_POLLS];
+				++counts[FIRST_LONG_POLL + bytes[1].data];
+			}
+			break;
+
+		case Direction::TX:
+			++counts[TX_MESSAGES];
+			if (bytes[0].addressByte())
+			{
+				++counts[CHIRPS];
+			}
+			else if (message.request == GP_REQUEST)
+			{
+				++counts[EXCEPTIONS];
+				++counts[FIRST_EXCEPTION + bytes[0].data];
+			}
+			break;
+
+		case Direction::COMMENT:
+			++counts[COMMENT_MESSAGES];
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// Purpose: Add the counts of the chunk just framed to its capture's stratum
+	void endChunk(std::uint64_t bytes_framed)
+	{
+		for (std::size_t metric = 0; metric != METRICS; ++metric)
+		{
+			double y = (double)counts[metric];
+			double x = (double)counts[denominator(metric)];
+			stratum_sums[metric] += y;
+			stratum_squares[metric] += y * y;
+			stratum_products[metric] += x * y;
+		}
+		++stratum_sampled;
+		++sampled_chunks;
+		framed_bytes += bytes_framed;
+	}
+
+	// Purpose: Scale the capture's sample up to the whole capture and add it to the estimates
+	void endCapture(std::uint64_t capture_bytes)
+	{
+		if (stratum_sampled)
+		{
+			double n = (double)stratum_sampled;
+			double big_n = (double)stratum_chunks;
+			double scale = (n > 1) ? ((big_n * big_n * (1 - (n / big_n))) / n) : 0;
+			for (std::size_t metric = 0; metric != METRICS; ++metric)
+			{
+				std::size_t over = denominator(metric);
+				double covariance = (n > 1) ? ((stratum_products[metric] - ((stratum_sums[over] * stratum_sums[metric]) / n)) / (n - 1)) : 0;
+				double variance = (n > 1) ? ((stratum_squares[metric] - ((stratum_sums[metric] * stratum_sums[metric]) / n)) / (n - 1)) : 0;
+				totals[metric] += big_n * (stratum_sums[metric] / n);
+				variances[metric] += scale * variance;
+				covariances[metric] += scale * covariance;
+				freedoms[metric] += (n > 1) ? ((scale * variance * scale * variance) / (n - 1)) : 0;
+			}
+			++captures;
+		}
+		stratum_sampled = 0;
+		capture_total_bytes += capture_bytes;
+	}
+
+	// Purpose: Write the estimates, as --stats reports the counts
+	void report(std::ostream &o, std::uint64_t file_bytes_read)
+	{
+		o << std::dec << std::setfill(' ') << "Sampled " << sampled_chunks << " of " << total_chunks << " chunks of " << (settings.chunk_bytes / 1024)
+			<< " KB from " << captures << " captures - framed " << framed_bytes << " of " << capture_total_bytes << " bytes ("
+			<< std::fixed << std::setprecision(2) << (capture_total_bytes ? ((100.0 * framed_bytes) / capture_total_bytes) : 0) << "%), read "
+			<< file_bytes_read << " bytes" << std::endl;
+		o << "Estimates with 95% confidence intervals" << std::endl;
+
+		o << "Messages " << estimate(MESSAGES)
+			<< " (RX " << estimate(RX_MESSAGES)
+			<< ", TX " << estimate(TX_MESSAGES)
+			<< ", COMMENT " << estimate(COMMENT_MESSAGES) << ")" << std::endl;
+
+		o << "Requests BP " << estimate(BROADCAST_POLLS)
+			<< ", GP " << estimate(GENERAL_POLLS)
+			<< ", LP " << estimate(LONG_POLLS)
+			<< ", missing start of message " << estimate(MISSING_START)
+			<< ", chirps " << estimate(CHIRPS) << std::endl;
+
+		o << "Address bytes (wakeup bit set) " << estimate(ADDRESS_BYTES) << std::endl;
+
+		o << "Line errors (bytes) framing " << estimate(FRAMING_ERRORS)
+			<< ", overrun " << estimate(OVERRUN_ERRORS)
+			<< ", break " << estimate(BREAK_ERRORS) << std::endl;
+		o << "Line error rates (of " << estimate(BYTES) << " bytes) framing " << share(FRAMING_ERRORS)
+			<< ", overrun " << share(OVERRUN_ERRORS)
+			<< ", break " << share(BREAK_ERRORS) << std::endl;
+
+		o << "Long polls " << estimate(LONG_POLLS) << std::endl;
+		for (std::size_t code = 0; code != 0x100; ++code)
+		{
+			if (totals[FIRST_LONG_POLL + code] > 0)
+			{
+				o << std::setw(24) << estimate(FIRST_LONG_POLL + code) << std::setw(20) << share(FIRST_LONG_POLL + code) << "  " << long_poll[code] << std::endl;
+			}
+		}
+
+		o << "Exceptions " << estimate(EXCEPTIONS) << std::endl;
+		for (std::size_t code = 0; code != 0x100; ++code)
+		{
+			if (totals[FIRST_EXCEPTION + code] > 0)
+			{
+				o << std::setw(24) << estimate(FIRST_EXCEPTION + code) << std::setw(20) << share(FIRST_EXCEPTION + code) << "  " << exceptions[code] << std::endl;
+			}
+		}
+		o.unsetf(std::ios::floatfield);
+		o << std::setprecision(6);
+	}
+
+private:
+	// What is counted in each chunk
+	enum Metric : std::size_t
+	{
+		MESSAGES,
+		RX_MESSAGES,
+		TX_MESSAGES,
+		COMMENT_MESSAGES,
+		BROADCAST_POLLS,
+		GENERAL_POLLS,
+		MISSING_START,
+		CHIRPS,
+		BYTES,
+		ADDRESS_BYTES,
+		FRAMING_ERRORS,
+		OVERRUN_ERRORS,
+		BREAK_ERRORS,
+		LONG_POLLS,
+		EXCEPTIONS,
+		FIRST_LONG_POLL,
+		FIRST_EXCEPTION = FIRST_LONG_POLL + 0x100,
+		METRICS = FIRST_EXCEPTION + 0x100
+	};
+
+	// Purpose: Two sided 95% quantile of Student's t - the normal 1.96 with plenty of degrees of freedom
+	static double t95(double degrees)
+	{
+		static const double small[30] =
+		{
+			12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+			2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+		};
+		if (degrees < 30)
+		{
+			return small[(degrees < 1) ? 0 : ((std::size_t)degrees - 1)]; // Rounded down - wider, not narrower
+		}
+
+		const double z = 1.96;
+		return z + (((z * z * z) + z) / (4 * degrees)) + (((5 * z * z * z * z * z) + (16 * z * z * z) + (3 * z)) / (96 * degrees * degrees));
+	}
+
+	// Purpose: 95% half width for a total with this variance, and the degrees of freedom of metric's total
+	double halfWidth(double variance, std::size_t metric) const
+	{
+		if (variance <= 0)
+		{
+			return 0;
+		}
+		double degrees = (freedoms[metric] > 0) ? ((variances[metric] * variances[metric]) / freedoms[metric]) : 1;
+		return t95(degrees) * std::sqrt(variance);
+	}
+
+	// Purpose: What a metric is a share of - itself when it is only reported as a total
+	static std::size_t denominator(std::size_t metric)
+	{
+		if ((metric >= FIRST_EXCEPTION) && (metric < METRICS))
+		{
+			return EXCEPTIONS;
+		}
+		if ((metric >= FIRST_LONG_POLL) && (metric < FIRST_EXCEPTION))
+		{
+			return LONG_POLLS;
+		}
+
+		switch (metric)
+		{
+		case RX_MESSAGES:
+		case TX_MESSAGES:
+		case COMMENT_MESSAGES:
+			return MESSAGES;
+
+		case ADDRESS_BYTES:
+		case FRAMING_ERRORS:
+		case OVERRUN_ERRORS:
+		case BREAK_ERRORS:
+			return BYTES;
+
+		default:
+			return metric;
+		}
+	}
+
+	// Purpose: A total and its interval, e.g. "12345 +/- 678"
+	std::string estimate(std::size_t metric) const
+	{
+		std::ostringstream text;
+		text << std::fixed << std::setprecision(0) << totals[metric] << " +/- " << halfWidth(variances[metric], metric);
+		return text.str();
+	}
+
+	// Purpose: A metric as a percentage of what it is a share of, and its interval, e.g. "12.34% +/- 0.56%"
+	std::string share(std::size_t metric) const
+	{
+		std::size_t over = denominator(metric);
+		std::ostringstream text;
+		if (totals[over] <= 0)
+		{
+			return "-";
+		}
+
+		double ratio = totals[metric] / totals[over];
+		double variance = (variances[metric] - (2 * ratio * covariances[metric]) + (ratio * ratio * variances[over])) / (totals[over] * totals[over]);
+		int digits = (over == BYTES) ? 4 : 2; // Error rates are small
+		text << std::fixed << std::setprecision(digits) << (100 * ratio) << "% +/- " << (100 * halfWidth(variance, metric)) << '%';
+		return text.str();
+	}
+
+	SampleSettings settings;
+	bool enabled = { false };
+	std::mt19937_64 random;
+
+	// The chunk being framed
+	std::uint64_t chunk_from = { 0 };
+	std::uint64_t chunk_to = { 0 };
+	std::array<std::uint64_t, METRICS> counts = {};
+
+	// The capture being sampled - sums over its sampled chunks of each count, its square, and its
+	// product with what it is a share of
+	std::uint64_t stratum_chunks = { 0 };
+	std::uint64_t stratum_sampled = { 0 };
+	std::array<double, METRICS> stratum_sums = {};
+	std::array<double, METRICS> stratum_squares = {};
+	std::array<double, METRICS> stratum_products = {};
+
+	// Estimated totals over every capture, their variances and covariances with what they are a share of
+	std::array<double, METRICS> totals = {};
+	std::array<double, METRICS> variances = {};
+	std::array<double, METRICS> covariances = {};
+	std::array<double, METRICS> freedoms = {}; // Sum over captures of each variance term squared over its degrees of freedom
+
+	std::uint64_t captures = { 0 };
+	std::uint64_t total_chunks = { 0 };
+	std::uint64_t sampled_chunks = { 0 };
+	std::uint64_t framed_bytes = { 0 };
+	std::uint64_t capture_total_bytes = { 0 };
+};
+
+SampledStatistics sampled_statistics;
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Filter.hpp"
+#include "ParseCommLog.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define __SSE2_SEARCH__
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Search the data bytes of a capture for one or more byte sequences. The status bytes are split out
+// on the fly so a sequence is found wherever it is on the wire - including across message boundaries
+
+struct PatternMatch
+{
+	std::uint64_t data_index;   // Index of the first matching data byte (file offset / 2)
+	std::size_t pattern;        // Which pattern matched
+};
+
+// Purpose: Index of the lowest set bit (bits must not be 0)
+inline unsigned int lowestBit(unsigned int bits)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, bits);
+	return index;
+#else
+	return __builtin_ctz(bits);
+#endif
+}
+
+// Purpose: Copy the data bytes out of status/data pairs
+inline void deinterleaveData(const BYTE *pairs, std::size_t pair_count, BYTE *data)
+{
+	std::size_t i = 0;
+
+#ifdef __SSE2_SEARCH__
+	// 16 pairs at a time - the data byte is the high byte of each little endian 16 bit lane
+	for (; i + 16 <= pair_count; i += 16)
+	{
+		__m128i low = _mm_loadu_si128((const __m128i *)(pairs + (i * 2)));
+		__m128i high = _mm_loadu_si128((const __m128i *)(pairs + (i * 2) + 16));
+		__m128i packed = _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8));
+		_mm_storeu_si128((__m128i *)(data + i), packed);
+	}
+#endif
+
+	for (; i != pair_count; ++i)
+	{
+		data[i] = pairs[(i * 2) + 1];
+	}
+}
+
+class PatternSearch
+{
+public:
+	// Purpose: Set the sequences to look for, each as hex digits e.g. "0172AB"
+	void set(const std::vector<std::string> &hex_patterns)
+	{
+		patterns.clear();
+		first_bytes.clear();
+		longest = 0;
+
+		for (auto &hex : hex_patterns)
+		{
+			patterns.push_back(parseHexSequence(hex));
+			longest = std::max(longest, patterns.back().size());
+
+			if (std::find(first_bytes.begin(), first_bytes.end(), patterns.back()[0]) == first_bytes.end())
+			{
+				first_bytes.push_back(patterns.back()[0]);
+			}
+		}
+	}
+
+	bool active() const { return !patterns.empty(); }
+
+	std::vector<BYTE> &pattern(std::size_t index) { return patterns[index]; }
+
+	// Purpose: Find every occurrence of every pattern in a capture. Matches come back in stream order
+	std::vector<PatternMatch> find(const std::vector<BYTE> &bytes)
+	{
+		std::vector<PatternMatch> matches;
+		std::size_t pair_count = bytes.size() / 2;
+
+		// De-interleave a block at a time, carrying the last (longest - 1) data bytes over into the next
+		// block so a match that straddles two blocks is still seen whole
+		std::vector<BYTE> data(BLOCK_PAIRS + longest);
+		std::size_t carried = 0;
+		std::uint64_t base = 0; // Data index of data[0]
+
+		for (std::size_t pair = 0; pair < pair_count; )
+		{
+			std::size_t block = pair_count - pair;
+			if (block > BLOCK_PAIRS)
+			{
+				block = BLOCK_PAIRS;
+			}
+			deinterleaveData(&bytes[pair * 2], block, &data[carried]);
+			pair += block;
+
+			std::size_t length = carried + block;
+			bool last_block = (pair == pair_count);
+			std::size_t limit = last_block ? length : ((length >= longest) ? (length - longest + 1) : 0);
+
+			scan(data.data(), length, limit, base, matches);
+
+			// Keep the bytes a match could still start in
+			carried = length - limit;
+			std::memmove(data.data(), data.data() + limit, carried);
+			base += limit;
+		}
+
+		return matches;
+	}
+
+private:
+	// Purpose: Look for matches starting at data[0..limit). data[limit..length) is only used to verify
+	void scan(const BYTE *data, std::size_t length, std::size_t limit, std::uint64_t base, std::vector<PatternMatch> &matches)
+	{
+		std::size_t i = 0;
+
+#ifdef __SSE2_SEARCH__
+		// First byte filter - compare 16 bytes against every distinct first byte at once and only
+		// verify where one of them hits
+		if (first_bytes.size() <= MAX_SIMD_FIRST_BYTES)
+		{
+			__m128i wanted[MAX_SIMD_FIRST_BYTES];
+			for (std::size_t f = 0; f != first_bytes.size(); ++f)
+			{
+				wanted[f] = _mm_set1_epi8((char)first_bytes[f]);
+			}
+
+			for (; i + 16 <= limit; i += 16)
+			{
+				__m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+				__m128i hits = _mm_cmpeq_epi8(block, wanted[0]);
+				for (std::size_t f = 1; f != first_bytes.size(); ++f)
+				{
+					hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, wanted[f]));
+				}
+
+				unsigned int bits = (unsigned int)_mm_movemask_epi8(hits);
+				while (bits)
+				{
+					verify(data, length, i + lowestBit(bits), base, matches);
+					bits &= bits - 1;
+				}
+			}
+		}
+#endif
+
+		for (; i < limit; ++i)
+		{
+			if (std::find(first_bytes.begin(), first_bytes.end(), data[i]) != first_bytes.end())
+			{
+				verify(data, length, i, base, matches);
+			}
+		}
+	}
+
+	// Purpose: Check every pattern at a position whose first byte is already known to match one of them
+	void verify(const BYTE *data, std::size_t length, std::size_t position, std::uint64_t base, std::vector<PatternMatch> &matches)
+	{
+		for (std::size_t p = 0; p != patterns.size(); ++p)
+		{
+			std::vector<BYTE> &sequence = patterns[p];
+			if ((position + sequence.size() <= length) &&
+				(std::memcmp(data + position, sequence.data(), sequence.size()) == 0))
+			{
+				PatternMatch match = { base + position, p };
+				matches.push_back(match);
+			}
+		}
+	}
+
+	// Status/data pairs de-interleaved per block
+	static const std::size_t BLOCK_PAIRS = { 1 << 20 };
+
+	// More distinct first bytes than this and the scalar filter is used instead
+	static const std::size_t MAX_SIMD_FIRST_BYTES = { 8 };
+
+	std::vector<std::vector<BYTE>> patterns;
+	std::vector<BYTE> first_bytes;
+	std::size_t longest = { 0 };
+};
+
+PatternSearch pattern_search;
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include "ParseCommLog.hpp"
+
+// Aggregate counts built one framed message at a time. Nothing is kept from a message once it has
+// been counted, so the counts take the same space however many messages there are
+class MessageStatistics
+{
+public:
+	// Purpose: Count a framed message
+	void add(Message &message)
+	{
+		auto &bytes = message.raw_status_and_data_bytes;
+
+		++total_messages;
+		++directions[message.direction];
+		++lengths[(bytes.size() < MAX_LENGTH) ? bytes.size() : MAX_LENGTH];
+
+		for (auto &status_and_data : bytes)
+		{
+			address_bytes += status_and_data.status.parity_error; // The wakeup bit, not an error
+			framing_errors += status_and_data.status.framing_error;
+			overrun_errors += status_and_data.status.overrun_error;
+			break_errors += status_and_data.status.break_error;
+		}
+
+		switch (message.direction)
+		{
+		case Direction::RX:
+			if (!bytes[0].addressByte())
+			{
+				++missing_start_of_message;
+			}
+			else if (bytes[0].broadcastPoll())
+			{
+				++broadcast_polls;
+			}
+			else if (bytes[0].generalPoll())
+			{
+				++general_polls;
+			}
+			else if (bytes.size() > 1)
+			{
+				// Long poll is the address followed by the command
+				++long_polls[bytes[1].data];
+			}
+			break;
+
+		case Direction::TX:
+			if (bytes[0].addressByte())
+			{
+				++chirps;
+			}
+			else if (message.request == GP_REQUEST)
+			{
+				++exceptions_seen[bytes[0].data];
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// Purpose: Write a compact report of everything counted
+	void report(std::ostream &o)
+	{
+		o << std::dec << std::setfill(' ')
+			<< "Messages " << total_messages
+			<< " (RX " << directions[Direction::RX]
+			<< ", TX " << directions[Direction::TX]
+			<< ", COMMENT " << directions[Direction::COMMENT] << ")" << std::endl;
+
+		o << "Requests BP " << broadcast_polls
+			<< ", GP " << general_polls
+			<< ", LP " << std::accumulate(long_polls.begin(), long_polls.end(), (std::uint64_t)0)
+			<< ", missing start of message " << missing_start_of_message
+			<< ", chirps " << chirps << std::endl;
+
+		o << "Address bytes (wakeup bit set) " << address_bytes << std::endl;
+
+		o << "Line errors (bytes) framing " << framing_errors
+			<< ", overrun " << overrun_errors
+			<< ", break " << break_errors << std::endl;
+
+		o << "Long polls" << std::endl;
+		for (std::size_t code = 0; code != long_polls.size(); ++code)
+		{
+			if (long_polls[code])
+			{
+				o << std::setw(12) << long_polls[code] << "  " << long_poll[code] << std::endl;
+			}
+		}
+
+		o << "Exceptions" << std::endl;
+		for (std::size_t code = 0; code != exceptions_seen.size(); ++code)
+		{
+			if (exceptions_seen[code])
+			{
+				o << std::setw(12) << exceptions_seen[code] << "  " << exceptions[code] << std::endl;
+			}
+		}
+
+		o << "Message lengths (bytes)" << std::endl;
+		for (std::size_t length = 1; length != lengths.size(); ++length)
+		{
+			if (lengths[length])
+			{
+				o << std::setw(12) << lengths[length] << "  " << length << ((length == MAX_LENGTH) ? "+" : "") << std::endl;
+			}
+		}
+	}
+
+	// Purpose: Write every count so far, for a checkpoint
+	void save(std::ostream &o) const
+	{
+		o << total_messages << ' ' << broadcast_polls << ' ' << general_polls << ' ' << missing_start_of_message << ' ' << chirps << ' '
+			<< address_bytes << ' ' << framing_errors << ' ' << overrun_errors << ' ' << break_errors << '\n';
+		saveCounts(o, directions);
+		saveCounts(o, lengths);
+		saveCounts(o, long_polls);
+		saveCounts(o, exceptions_seen);
+	}
+
+	// Purpose: Carry on counting from what save wrote. Throws std::runtime_error if it can't be read
+	void restore(std::istream &i)
+	{
+		i >> total_messages >> broadcast_polls >> general_polls >> missing_start_of_message >> chirps
+			>> address_bytes >> framing_errors >> overrun_errors >> break_errors;
+		restoreCounts(i, directions);
+		restoreCounts(i, lengths);
+		restoreCounts(i, long_polls);
+		restoreCounts(i, exceptions_seen);
+		if (!i)
+		{
+			throw std::runtime_error("Checkpoint is corrupt");
+		}
+	}
+
+private:
+	template <std::size_t N>
+	static void saveCounts(std::ostream &o, const std::array<std::uint64_t, N> &counts)
+	{
+		for (auto count : counts)
+		{
+			o << count << ' ';
+		}
+		o << '\n';
+	}
+
+	template <std::size_t N>
+	static void restoreCounts(std::istream &i, std::array<std::uint64_t, N> &counts)
+	{
+		for (auto &count : counts)
+		{
+			i >> count;
+		}
+	}
+
+	// Messages this long or longer share the last histogram bucket
+	static const std::size_t MAX_LENGTH = { 64 };
+
+	std::uint64_t total_messages = { 0 };
+	std::array<std::uint64_t, 4> directions = {};
+	std::array<std::uint64_t, MAX_LENGTH + 1> lengths = {};
+
+	std::uint64_t broadcast_polls = { 0 };
+	std::uint64_t general_polls = { 0 };
+	std::uint64_t missing_start_of_message = { 0 };
+	std::uint64_t chirps = { 0 };
+	std::array<std::uint64_t, 0x100> long_polls = {};
+	std::array<std::uint64_t, 0x100> exceptions_seen = {};
+
+	std::uint64_t address_bytes = { 0 };
+	std::uint64_t framing_errors = { 0 };
+	std::uint64_t overrun_errors = { 0 };
+	std::uint64_t break_errors = { 0 };
+};
+
+MessageStatistics message_statistics;
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rotated captures - the capture software starts a new file every so often, named
+// <maker>_<mac>_SAS<port>_<epoch>.log (e.g. IGT_00012952A0BF_SAS1_1419032367.log), so a message on the
+// line when the file was rotated is cut in two. Stitching puts the segments of each machine and port
+// back in order and frames them as one stream, so those messages come out whole. Compact archives of
+// segments (.log.pcz) are stitched the same way. Any other capture is a stream of its own
+
+struct CaptureSegment
+{
+	std::string filename;
+	std::string machine; // <maker>_<mac>
+	std::uint32_t port = { 0 };
+	std::uint64_t epoch = { 0 };
+	bool rotated = { false }; // Named as a rotated segment
+};
+
+// Purpose: Pick the machine, port and epoch out of a segment's file name. False if it isn't named as one
+inline bool parseSegmentName(const std::string &filename, CaptureSegment &segment)
+{
+	segment.filename = filename;
+	segment.rotated = false;
+
+	std::string name = filename.substr(filename.find_last_of("/\\") + 1); // npos + 1 is the whole name
+	for (const char *extension : { ".log.pcz", ".log" })
+	{
+		std::string::size_type length = std::string(extension).size();
+		if ((name.size() > length) && (name.compare(name.size() - length, length, extension) == 0))
+		{
+			name.erase(name.size() - length);
+			break;
+		}
+	}
+
+	// <maker>_<mac>_SAS<port>_<epoch>
+	std::string::size_type epoch_separator = name.rfind('_');
+	if ((epoch_separator == std::string::npos) || (epoch_separator == 0))
+	{
+		return false;
+	}
+	std::string::size_type port_separator = name.rfind('_', epoch_separator - 1);
+	if ((port_separator == std::string::npos) || (name.find('_') == port_separator))
+	{
+		return false; // No <maker>_<mac> in front
+	}
+
+	std::string port = name.substr(port_separator + 1, epoch_separator - port_separator - 1);
+	std::string epoch = name.substr(epoch_separator + 1);
+	if ((port.size() < 4) || (port.size() > 12) || (port.compare(0, 3, "SAS") != 0) || (port.find_first_not_of("0123456789", 3) != std::string::npos) ||
+		epoch.empty() || (epoch.find_first_not_of("0123456789") != std::string::npos) || (epoch.size() > 19))
+	{
+		return false;
+	}
+
+	segment.machine = name.substr(0, port_separator);
+	segment.port = (std::uint32_t)std::stoul(port.substr(3)); // At most 9 digits, and 19 of epoch, so neither overflows
+	segment.epoch = std::stoull(epoch);
+	segment.rotated = true;
+	return true;
+}
+
+// Purpose: Sort the captures into streams - the segments of each machine and port in epoch order,
+// streams in machine and port order, then every capture that isn't a segment as a stream of its own
+inline std::vector<std::vector<CaptureSegment>> stitchSegments(const std::vector<std::string> &filenames)
+{
+	std::vector<CaptureSegment> segments;
+	std::vector<CaptureSegment> others;
+	for (auto &filename : filenames)
+	{
+		CaptureSegment segment;
+		if (parseSegmentName(filename, segment))
+		{
+			segments.push_back(segment);
+		}
+		else
+		{
+			others.push_back(segment);
+		}
+	}
+
+	std::stable_sort(segments.begin(), segments.end(), [](const CaptureSegment &a, const CaptureSegment &b)
+	{
+		if (a.machine != b.machine)
+		{
+			return a.machine < b.machine;
+		}
+		if (a.port != b.port)
+		{
+			return a.port < b.port;
+		}
+		return a.epoch < b.epoch;
+	});
+
+	std::vector<std::vector<CaptureSegment>> streams;
+	for (auto &segment : segments)
+	{
+		if (streams.empty() || (streams.back().back().machine != segment.machine) || (streams.back().back().port != segment.port))
+		{
+			streams.push_back(std::vector<CaptureSegment>());
+		}
+		streams.back().push_back(segment);
+	}
+	for (auto &other : others)
+	{
+		streams.push_back(std::vector<CaptureSegment>(1, other));
+	}
+
+	return streams;
+}
@@ -0,0 +1,475 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Archive.hpp"
+#include "LineErrors.hpp"
+#include "ParseCommLog.hpp"
+#include "Search.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define __SSE2_WINDOW__
+#include <emmintrin.h>
+#endif
+
+// Decode only a window of a capture - for looking around an incident without framing, parsing and
+// formatting the whole file first. The capture is read a block at a time, only as far as finding the
+// window needs, and only the window itself is framed
+//
+//   window := "bytes=" start "-" end        capture offsets (decimal or 0x hex), end not included
+//           | "messages=" first "-" last    message numbers counted from 0, last included
+//           | "around=" hex "," count       count messages centred on the one the first match of the
+//                                           data bytes (as --search) starts in
+//
+// e.g. "bytes=0x100000-0x104000", "messages=5000-5999" or "around=0172,2000"
+//
+// Where a message starts depends only on its first status byte and the one before it, so the window
+// is found by stepping over status bytes alone. Message numbers count every framed message, before
+// any filter. Framing starts from the last request at or before the window - the framer needs nothing
+// from before it to frame the same messages, with the same request for each response, as it would
+// framing the whole capture
+
+enum class WindowType
+{
+	NONE,
+	BYTES,
+	MESSAGES,
+	AROUND
+};
+
+// Where a window is in a capture - all capture offsets
+struct WindowRange
+{
+	std::uint64_t frame_from;  // Start of the last request at or before the window
+	std::uint64_t begin;       // Start of the first message in the window
+	std::uint64_t end;         // Just past the last message in the window
+};
+
+class CaptureWindow
+{
+public:
+	CaptureWindow()
+	{
+		for (int status = 0; status != 0x100; ++status)
+		{
+			StatusAndData status_and_data((BYTE)status, 0);
+			if (status_and_data.commentByte())
+			{
+				pair_kind[status] = COMMENT_PAIR;
+			}
+			else if (status_and_data.tx())
+			{
+				pair_kind[status] = TX_PAIR;
+			}
+			else if (status_and_data.addressByte())
+			{
+				pair_kind[status] = ADDRESS_PAIR;
+			}
+			else
+			{
+				pair_kind[status] = RX_PAIR;
+			}
+		}
+
+		for (BYTE previous_kind = COMMENT_PAIR; previous_kind <= ADDRESS_PAIR; ++previous_kind)
+		{
+			for (BYTE kind = COMMENT_PAIR; kind <= ADDRESS_PAIR; ++kind)
+			{
+				message_starts[(previous_kind << 2) | kind] = startsMessage(kind, previous_kind) ? 1 : 0;
+			}
+		}
+	}
+
+	// Purpose: Set the window to decode (see above). Throws std::invalid_argument on a bad window
+	void set(const std::string &window)
+	{
+		type = WindowType::NONE;
+		if (window.empty())
+		{
+			return;
+		}
+
+		std::string::size_type equals = window.find('=');
+		if (equals == std::string::npos)
+		{
+			throw std::invalid_argument("Window '" + window + "' is missing '='");
+		}
+
+		std::string key = window.substr(0, equals);
+		std::string value = window.substr(equals + 1);
+
+		if (key == "around")
+		{
+			std::string::size_type comma = value.find(',');
+			if (comma == std::string::npos)
+			{
+				throw std::invalid_argument("Window '" + window + "' needs a number of messages after the bytes e.g. around=0172,2000");
+			}
+
+			search.set(std::vector<std::string>(1, value.substr(0, comma)));
+			first = parseNumber(value.substr(comma + 1), window);
+			if (first == 0)
+			{
+				throw std::invalid_argument("Window '" + window + "' needs at least one message");
+			}
+			type = WindowType::AROUND;
+			return;
+		}
+
+		std::string::size_type dash = value.find('-');
+		if (dash == std::string::npos)
+		{
+			throw std::invalid_argument("Window '" + window + "' needs a range e.g. " + key + "=1000-2000");
+		}
+		first = parseNumber(value.substr(0, dash), window);
+		last = parseNumber(value.substr(dash + 1), window);
+
+		if (key == "bytes")
+		{
+			if (last <= first)
+			{
+				throw std::invalid_argument("Window '" + window + "' must end after it starts");
+			}
+			type = WindowType::BYTES;
+		}
+		else if (key == "messages")
+		{
+			if (last < first)
+			{
+				throw std::invalid_argument("Window '" + window + "' must end after it starts");
+			}
+			type = WindowType::MESSAGES;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown window '" + key + "' - use bytes, messages or around");
+		}
+	}
+
+	// Purpose: Set a window of capture offsets [from, to) directly, as "bytes=" would
+	void setBytes(std::uint64_t from, std::uint64_t to)
+	{
+		first = from;
+		last = to;
+		type = WindowType::BYTES;
+	}
+
+	bool active() const { return type != WindowType::NONE; }
+
+	// Purpose: Find the window in a capture. Throws std::runtime_error if the capture can't be read or
+	// the window isn't in it
+	WindowRange locate(const std::string &filename)
+	{
+		open(filename);
+
+		std::uint64_t begin_pair = 0;
+		std::uint64_t end_pair = 0;
+
+		switch (type)
+		{
+		case WindowType::BYTES:
+			if ((first / 2) >= pair_count)
+			{
+				throw std::runtime_error("Window starts past the end of the capture");
+			}
+			begin_pair = messageStart(first / 2);
+			end_pair = nextMessageStart((last - 1) / 2);
+			break;
+
+		case WindowType::MESSAGES:
+			begin_pair = countMessages(0, 0, first);
+			if (begin_pair == pair_count)
+			{
+				throw std::runtime_error("Capture has fewer than " + std::to_string(first + 1) + " messages");
+			}
+			end_pair = countMessages(begin_pair, first, last + 1);
+			break;
+
+		case WindowType::AROUND:
+		{
+			std::uint64_t match_pair = findFirstMatch();
+			if (match_pair == pair_count)
+			{
+				throw std::runtime_error("Bytes not found in the capture");
+			}
+
+			// Half the messages before the one the match starts in, the rest from it on
+			begin_pair = messageStart(match_pair);
+			end_pair = countMessages(begin_pair, 0, first - (first / 2));
+			for (std::uint64_t before = 0; (before != (first / 2)) && begin_pair; ++before)
+			{
+				begin_pair = messageStart(begin_pair - 1);
+			}
+		}
+		break;
+
+		default:
+			break;
+		}
+
+		WindowRange range;
+		range.frame_from = lastRequest(begin_pair) * 2;
+		range.begin = begin_pair * 2;
+		range.end = end_pair * 2;
+		return range;
+	}
+
+	// Purpose: Read part of the capture the window was found in
+	std::vector<BYTE> read(std::uint64_t from, std::uint64_t to)
+	{
+		std::vector<BYTE> bytes((std::vector<BYTE>::size_type)(to - from));
+		file.clear();
+		file.seekg((std::streamoff)from);
+		if (!bytes.empty() && !file.read((char *)bytes.data(), bytes.size()))
+		{
+			throw std::runtime_error("File could not be read");
+		}
+		return bytes;
+	}
+
+private:
+	// How the framer treats a status byte
+	enum PairKind : BYTE
+	{
+		COMMENT_PAIR,
+		TX_PAIR,
+		RX_PAIR,
+		ADDRESS_PAIR,  // RX'd with the wakeup bit - always starts a new message
+	};
+
+	static std::uint64_t parseNumber(const std::string &value, const std::string &window)
+	{
+		std::size_t used = 0;
+		unsigned long long number = 0;
+		bool hex = (value.size() > 2) && (value[0] == '0') && ((value[1] == 'x') || (value[1] == 'X'));
+		try
+		{
+			number = std::stoull(value, &used, hex ? 16 : 10);
+		}
+		catch (std::exception const&)
+		{
+			used = 0;
+		}
+
+		if (value.empty() || (used != value.size()))
+		{
+			throw std::invalid_argument("Window '" + window + "' has '" + value + "' where a number should be");
+		}
+
+		return number;
+	}
+
+	void open(const std::string &filename)
+	{
+		file.close();
+		file.clear();
+		file.open(filename, std::ios::in | std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("File could not be opened");
+		}
+
+		char magic[sizeof(COMPACT_MAGIC)];
+		if (file.read(magic, sizeof(magic)) && (std::memcmp(magic, COMPACT_MAGIC, sizeof(magic)) == 0))
+		{
+			throw std::runtime_error("Compact archives can't be windowed - use the capture");
+		}
+
+		file.clear();
+		file.seekg(0, std::ios::end);
+		pair_count = (std::uint64_t)file.tellg() / 2;
+		block.clear();
+		block_pair = 0;
+	}
+
+	// Purpose: Status byte of a pair, reading the block it is in if it isn't already
+	BYTE status(std::uint64_t pair)
+	{
+		if ((pair < block_pair) || (pair >= block_pair + (block.size() / 2)))
+		{
+			block_pair = pair - (pair % BLOCK_PAIRS);
+			std::uint64_t end = block_pair + BLOCK_PAIRS;
+			block = read(block_pair * 2, ((end < pair_count) ? end : pair_count) * 2);
+		}
+		return block[(std::size_t)((pair - block_pair) * 2)];
+	}
+
+	static bool rxKind(BYTE kind) { return kind >= RX_PAIR; }
+
+	// Purpose: Does a new message start at a pair - the same decision the framer makes
+	bool startsMessage(BYTE kind, BYTE previous_kind)
+	{
+		return (kind == ADDRESS_PAIR) || (rxKind(kind) ? !rxKind(previous_kind) : (kind != previous_kind));
+	}
+
+	bool startsMessage(std::uint64_t pair)
+	{
+		return !pair || startsMessage(pair_kind[status(pair)], pair_kind[status(pair - 1)]);
+	}
+
+	// Purpose: Start of the message a pair is in
+	std::uint64_t messageStart(std::uint64_t pair)
+	{
+		while (!startsMessage(pair))
+		{
+			--pair;
+		}
+		return pair;
+	}
+
+	// Purpose: Start of the first message after the one a pair is in, or the end of the capture
+	std::uint64_t nextMessageStart(std::uint64_t pair)
+	{
+		if (pair >= pair_count)
+		{
+			return pair_count;
+		}
+
+		BYTE previous_kind = pair_kind[status(pair)];
+		while (++pair != pair_count)
+		{
+			BYTE kind = pair_kind[status(pair)];
+			if (startsMessage(kind, previous_kind))
+			{
+				break;
+			}
+			previous_kind = kind;
+		}
+		return pair;
+	}
+
+	// Purpose: Step from the start of message number 'number' at 'pair' to the start of message number
+	// 'wanted'. Returns the end of the capture if it has fewer messages. Goes through a block at a time
+	// - this may have to step over most of the capture
+	std::uint64_t countMessages(std::uint64_t pair, std::uint64_t number, std::uint64_t wanted)
+	{
+		if ((pair == pair_count) || (number == wanted))
+		{
+			return pair;
+		}
+
+		BYTE previous_kind = pair_kind[status(pair)];
+		++pair;
+		while (pair != pair_count)
+		{
+			status(pair); // Read the block the pair is in
+			const BYTE *statuses = &block[(std::size_t)((pair - block_pair) * 2)];
+			std::size_t in_block = (std::size_t)(block_pair + (block.size() / 2) - pair);
+
+			std::size_t i = 0;
+
+#ifdef __SSE2_WINDOW__
+			const __m128i low_byte = _mm_set1_epi16(0x00FF);
+			const __m128i rx_bit = _mm_set1_epi8(0x01);
+			const __m128i bits_321 = _mm_set1_epi8(0x0E);
+			const __m128i comment_bits = _mm_set1_epi8(0x02);
+			const __m128i wakeup_bit = _mm_set1_epi8(0x20);
+
+			// Direction of the pair before as TX 0, RX 1, comment 2
+			int previous_direction = (previous_kind == COMMENT_PAIR) ? 2 : (rxKind(previous_kind) ? 1 : 0);
+
+			// 16 pairs at a time - a message starts at each wakeup byte and wherever the direction changes
+			for (; i + 16 <= in_block; i += 16)
+			{
+				__m128i low = _mm_loadu_si128((const __m128i *)(statuses + (i * 2)));
+				__m128i high = _mm_loadu_si128((const __m128i *)(statuses + (i * 2) + 16));
+				__m128i status = _mm_packus_epi16(_mm_and_si128(low, low_byte), _mm_and_si128(high, low_byte));
+
+				__m128i comment = _mm_cmpeq_epi8(_mm_and_si128(status, bits_321), comment_bits);
+				__m128i rx = _mm_andnot_si128(comment, _mm_cmpeq_epi8(_mm_and_si128(status, rx_bit), rx_bit));
+				__m128i address = _mm_and_si128(rx, _mm_cmpeq_epi8(_mm_and_si128(status, wakeup_bit), wakeup_bit));
+
+				__m128i direction = _mm_or_si128(_mm_and_si128(rx, rx_bit), _mm_and_si128(comment, comment_bits));
+				__m128i previous = _mm_or_si128(_mm_slli_si128(direction, 1), _mm_cvtsi32_si128(previous_direction));
+
+				unsigned int starts = ((unsigned int)_mm_movemask_epi8(address) | ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(direction, previous))) & 0xFFFF;
+				unsigned int count = countBits(starts);
+				if (number + count >= wanted)
+				{
+					for (;; starts &= starts - 1)
+					{
+						if (++number == wanted)
+						{
+							return pair + i + lowestBit(starts);
+						}
+					}
+				}
+				number += count;
+				previous_direction = _mm_extract_epi16(direction, 7) >> 8;
+			}
+
+			if (i)
+			{
+				previous_kind = pair_kind[statuses[(i - 1) * 2]];
+			}
+#endif
+
+			// Table lookups rather than tests - a message starts every few pairs, too often to predict
+			for (; i != in_block; ++i)
+			{
+				BYTE kind = pair_kind[statuses[i * 2]];
+				number += message_starts[(previous_kind << 2) | kind];
+				if (number == wanted)
+				{
+					return pair + i;
+				}
+				previous_kind = kind;
+			}
+			pair += in_block;
+		}
+		return pair;
+	}
+
+	// Purpose: Start of the last request at or before a message start - 0 if there isn't one
+	std::uint64_t lastRequest(std::uint64_t pair)
+	{
+		for (;;)
+		{
+			if (rxKind(pair_kind[status(pair)]) || !pair)
+			{
+				return pair;
+			}
+			pair = messageStart(pair - 1);
+		}
+	}
+
+	// Purpose: Pair the first match of the window's bytes starts at, or the end of the capture. Each
+	// block overlaps the next by enough for a match straddling the two to be seen whole
+	std::uint64_t findFirstMatch()
+	{
+		std::uint64_t overlap = search.pattern(0).size() - 1;
+		for (std::uint64_t pair = 0; pair < pair_count; pair += BLOCK_PAIRS)
+		{
+			std::uint64_t end = pair + BLOCK_PAIRS + overlap;
+			std::vector<BYTE> bytes = read(pair * 2, ((end < pair_count) ? end : pair_count) * 2);
+			std::vector<PatternMatch> matches = search.find(bytes);
+			if (!matches.empty())
+			{
+				return pair + matches.front().data_index;
+			}
+		}
+		return pair_count;
+	}
+
+	// Capture is read this many status/data pairs at a time
+	static const std::uint64_t BLOCK_PAIRS = { 1 << 19 };
+
+	WindowType type = { WindowType::NONE };
+	std::uint64_t first = { 0 };  // Start of the range, or the number of messages around a match
+	std::uint64_t last = { 0 };
+	PatternSearch search;
+
+	BYTE pair_kind[0x100];
+	BYTE message_starts[16];  // Indexed by (previous kind << 2) | kind
+
+	std::ifstream file;
+	std::uint64_t pair_count = { 0 };
+	std::vector<BYTE> block;
+	std::uint64_t block_pair = { 0 };  // First pair in the block
+};
+
+CaptureWindow capture_window;